@@ -0,0 +1,17 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+// Best wall time of several runs, in milliseconds.
+template <class F>
+double MeasureMs(F&& func, int repetitions = 5) {
+    double best = 0;
+    for (int i = 0; i < repetitions; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = (i == 0 ? elapsed.count() : std::min(best, elapsed.count()));
+    }
+    return best;
+}
@@ -0,0 +1,28 @@
+#include <catch.hpp>
+
+#include <iostream>
+
+#include <scheme.h>
+
+#include "bench.h"
+
+TEST_CASE("Integer loop", "[.bench]") {
+    Interpreter interpreter;
+    interpreter.Run("(define (slow-add x y) (if (= x 0) y (slow-add (- x 1) (+ y 1))))");
+    auto ms = MeasureMs([&] { interpreter.Run("(slow-add 1000 1000)"); }, 50);
+    std::cerr << "(slow-add 1000 1000): " << ms << " ms\n";
+}
+
+TEST_CASE("Local variable access", "[.bench]") {
+    Interpreter interpreter;
+    interpreter.Run(R"EOF(
+        (define (sum-squares n a b c d)
+            (define (square x) (* x x))
+            (if (= n 0)
+                0
+                (+ (square a) (square b) (square c) (square d)
+                   (sum-squares (- n 1) b c d a))))
+    )EOF");
+    auto ms = MeasureMs([&] { interpreter.Run("(sum-squares 500 1 2 3 4)"); }, 50);
+    std::cerr << "(sum-squares 500 1 2 3 4): " << ms << " ms\n";
+}
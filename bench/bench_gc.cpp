@@ -0,0 +1,57 @@
+#include <catch.hpp>
+
+#include <iostream>
+#include <string>
+
+#include <scheme.h>
+
+#include "bench.h"
+
+namespace {
+void BuildList(Interpreter* interpreter, size_t length) {
+    std::string definition = "(define lst '(";
+    for (size_t i = 0; i < length; ++i) {
+        definition += std::to_string(i) + ' ';
+    }
+    interpreter->Run(definition + "))");
+}
+}  // namespace
+
+TEST_CASE("Full collection of a long list", "[.bench]") {
+    for (size_t length : {10'000, 100'000, 1'000'000}) {
+        Interpreter interpreter;
+        BuildList(&interpreter, length);
+        auto ms = MeasureMs([&] { interpreter.CollectGarbage(); });
+        std::cerr << "Collecting with a list of " << length << " cells: " << ms << " ms\n";
+    }
+}
+
+TEST_CASE("Small requests next to a large live heap", "[.bench]") {
+    for (bool generational : {true, false}) {
+        Interpreter interpreter;
+        interpreter.GetHeap().SetGenerational(generational);
+        BuildList(&interpreter, 100'000);
+        auto ms = MeasureMs([&] {
+            for (int i = 0; i < 1000; ++i) {
+                interpreter.Run("(+ 1 2)");
+            }
+        });
+        std::cerr << "1000 x (+ 1 2), generational " << generational << ": " << ms << " ms\n";
+    }
+}
+
+TEST_CASE("Parallel collection of a large tree", "[.bench]") {
+    for (size_t threads : {1, 2, 4, 8}) {
+        Interpreter interpreter;
+        interpreter.GetHeap().SetParallelism(threads);
+        interpreter.Run("(define (tree d) (if (= d 0) '() (cons (tree (- d 1)) (tree (- d 1)))))");
+        interpreter.Run("(define t (tree 21))");
+        interpreter.CollectGarbage();
+        auto mark = interpreter.GetHeap().GetStats().last_mark;
+        interpreter.Run("(set! t '())");
+        interpreter.CollectGarbage();
+        auto sweep = interpreter.GetHeap().GetStats().last_sweep;
+        std::cerr << threads << " threads, 2M cells: mark " << mark.count() / 1e6 << " ms, sweep "
+                  << sweep.count() / 1e6 << " ms\n";
+    }
+}
@@ -0,0 +1,91 @@
+#include <catch.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <parser.h>
+
+#include "bench.h"
+
+namespace {
+// A quoted list of `count` definitions, about 60 bytes each.
+std::string GenerateInput(size_t count) {
+    std::string input = "'(";
+    for (size_t i = 0; i < count; ++i) {
+        auto name = "rule-" + std::to_string(i);
+        input += "(define (" + name + " x) (if (< x " + std::to_string(i) + ") (" + name +
+                 " (+ x 1)) 'done))\n";
+    }
+    return input + ")";
+}
+
+// Long runs of digits and of indentation, which the scanner takes in bulk.
+std::string GenerateNumbers(size_t count) {
+    std::string input = "'(";
+    for (size_t i = 0; i < count; ++i) {
+        input += "\n" + std::string(i % 40, ' ') + std::to_string(i * 2654435761) + " -" +
+                 std::to_string(i);
+    }
+    return input + ")";
+}
+
+// Pretty-printed rules: deep indentation and long names.
+std::string GenerateIndented(size_t count) {
+    std::string input = "'(";
+    for (size_t i = 0; i < count; ++i) {
+        auto depth = i % 16;
+        input += "\n" + std::string(4 * depth, ' ') + "(match-incoming-request-header-" +
+                 std::to_string(i) + "\n" + std::string(4 * depth + 2, ' ') +
+                 "accept-encoding-with-quality-value " + std::to_string(i * 40503) + ")";
+    }
+    return input + ")";
+}
+
+size_t CountTokens(std::string_view input) {
+    size_t count = 0;
+    for (BufferTokenizer tokenizer{input}; !tokenizer.IsEnd(); tokenizer.Next()) {
+        ++count;
+    }
+    return count;
+}
+}  // namespace
+
+TEST_CASE("Reading a large input", "[.bench]") {
+    auto input = GenerateInput(100'000);
+    auto megabytes = input.size() / 1e6;
+    auto stream_ms = MeasureMs([&] {
+        std::stringstream ss{input};
+        Tokenizer tokenizer{&ss};
+        Heap heap;
+        Read(&tokenizer, &heap);
+    });
+    auto buffer_ms = MeasureMs([&] {
+        BufferTokenizer tokenizer{input};
+        Heap heap;
+        Read(&tokenizer, &heap);
+    });
+    std::cerr << "Reading " << megabytes << " MB from a stream: " << stream_ms << " ms\n";
+    std::cerr << "Reading " << megabytes << " MB from a buffer: " << buffer_ms << " ms\n";
+}
+
+TEST_CASE("Tokenizer throughput", "[.bench]") {
+    auto widest = GetScanWidth();
+    std::pair<const char*, std::string> inputs[] = {{"definitions", GenerateInput(100'000)},
+                                                    {"numbers", GenerateNumbers(200'000)},
+                                                    {"indented", GenerateIndented(50'000)}};
+    for (const auto& [name, input] : inputs) {
+        for (auto width : {ScanWidth::kScalar, ScanWidth::kSse2, ScanWidth::kAvx2}) {
+            SetScanWidth(width);
+            if (GetScanWidth() != width) {
+                continue;
+            }
+            auto ms = MeasureMs([&] { CountTokens(input); });
+            std::cerr << "Tokenizing " << name << ", scan width " << static_cast<int>(width)
+                      << ": " << input.size() / 1e3 / ms << " MB/s\n";
+        }
+    }
+    SetScanWidth(widest);
+}
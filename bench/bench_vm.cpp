@@ -0,0 +1,69 @@
+#include <catch.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <scheme.h>
+
+#include "bench.h"
+
+namespace {
+struct Program {
+    std::string name;
+    std::vector<std::string> definitions;
+    std::string expression;
+};
+
+// The programs of the lambda tests, scaled up.
+const std::vector<Program> kPrograms = {
+    {"slow-add",
+     {"(define (slow-add x y) (if (= x 0) y (slow-add (- x 1) (+ y 1))))"},
+     "(slow-add 20000 1)"},
+    {"fib", {"(define (fib x) (if (< x 3) 1 (+ (fib (- x 1)) (fib (- x 2)))))"}, "(fib 18)"},
+    {"mutual calls",
+     {"(define (foo x) (if (< x 2) 42 (bar (- x 1))))",
+      "(define (bar x) (if (< x 2) 24 (foo (/ x 2))))",
+      "(define (run n acc) (if (= n 0) acc (run (- n 1) (+ acc (foo 1000)))))"},
+     "(run 1000 0)"},
+    {"closures",
+     {"(define (range x) (lambda () (set! x (+ x 1)) x))",
+      "(define (drain r n) (if (= n 0) (r) (begin-drain r n)))",
+      "(define (begin-drain r n) (r) (drain r (- n 1)))"},
+     "(drain (range 0) 20000)"},
+    {"lists",
+     {"(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+      "(define (sum lst acc) (if (null? lst) acc (sum (cdr lst) (+ acc (car lst)))))"},
+     "(sum (build 10000 '()) 0)"},
+};
+}  // namespace
+
+TEST_CASE("Tree walking and bytecode", "[.bench]") {
+    for (const auto& program : kPrograms) {
+        for (bool bytecode : {false, true}) {
+            Interpreter interpreter;
+            interpreter.GetContext().SetBytecode(bytecode);
+            for (const auto& definition : program.definitions) {
+                interpreter.Run(definition);
+            }
+            auto ms = MeasureMs([&] { interpreter.Run(program.expression); }, 10);
+            std::cerr << program.name << (bytecode ? ", bytecode: " : ", tree walking: ") << ms
+                      << " ms\n";
+        }
+    }
+}
+
+TEST_CASE("Bytecode and machine code", "[.bench]") {
+    for (const auto& program : kPrograms) {
+        for (size_t threshold : {0, 1}) {
+            Interpreter interpreter;
+            interpreter.GetContext().SetJitThreshold(threshold);
+            for (const auto& definition : program.definitions) {
+                interpreter.Run(definition);
+            }
+            auto ms = MeasureMs([&] { interpreter.Run(program.expression); }, 10);
+            std::cerr << program.name << (threshold ? ", machine code: " : ", bytecode: ") << ms
+                      << " ms\n";
+        }
+    }
+}
@@ -0,0 +1,486 @@
+#include <bytecode.h>
+
+#include <array>
+#include <exception>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <context.h>
+#include <internal_funcs.h>
+
+void Bytecode::Trace(Tracer& tracer) {
+    for (auto& constant : constants) {
+        tracer.Visit(constant);
+    }
+    for (auto& site : sites) {
+        for (auto& arg : site.args) {
+            tracer.Visit(arg);
+        }
+    }
+    for (auto& binding : globals) {
+        tracer.Visit(binding);
+    }
+}
+
+namespace {
+
+struct BinaryBuiltin {
+    std::string_view name;
+    NativeFunc func;
+    Opcode op;
+};
+
+const std::array<BinaryBuiltin, 9> kBinaryBuiltins = {{
+    {"+", &FuncAdd, Opcode::kAdd},
+    {"-", &FuncSub, Opcode::kSub},
+    {"*", &FuncMul, Opcode::kMul},
+    {"/", &FuncDiv, Opcode::kDiv},
+    {"=", &FuncEqual, Opcode::kEqual},
+    {"<", &FuncLess, Opcode::kLess},
+    {">", &FuncGreater, Opcode::kGreater},
+    {"<=", &FuncLessEqual, Opcode::kLessEqual},
+    {">=", &FuncGreaterEqual, Opcode::kGreaterEqual},
+}};
+
+class BytecodeCompiler {
+public:
+    explicit BytecodeCompiler(Heap& heap)
+        : heap_(heap),
+          code_(std::make_unique<Bytecode>()) {
+        for (const auto& builtin : kBinaryBuiltins) {
+            binary_.push_back(heap.Intern(builtin.name));
+        }
+    }
+
+    std::unique_ptr<Bytecode> Compile(const ArgsVec& body) {
+        for (size_t i = 0; i < body.size(); ++i) {
+            Compile(body[i], 0, i + 1 == body.size());
+        }
+        Emit(Opcode::kReturn, 0);
+        return std::move(code_);
+    }
+
+private:
+    // Leaves the value of `expr` in register `dst`, using the registers above it as temporaries.
+    void Compile(AST expr, uint32_t dst, bool tail) {
+        if (!expr || IsFixnum(expr) || Is<Number>(expr) || Is<Boolean>(expr)) {
+            Emit(Opcode::kLoadConst, dst, AddConstant(expr));
+        } else if (auto symbol = As<Symbol>(expr)) {
+            Emit(Opcode::kLoadGlobal, dst, AddConstant(symbol), AddGlobal());
+        } else if (auto ref = As<LocalRef>(expr)) {
+            Emit(Opcode::kLoadLocal, dst, ref->GetDepth(), ref->GetSlot());
+        } else if (Is<FoldedForm>(expr)) {
+            // Checks the names the value depends on before loading it.
+            Emit(Opcode::kEval, dst, AddConstant(expr));
+        } else if (auto form = As<SpecialForm>(expr)) {
+            CompileSpecialForm(form, dst, tail);
+        } else if (!Is<Cell>(expr) || !CompileApplication(expr, dst, tail)) {
+            Emit(Opcode::kEval, dst, AddConstant(expr));
+        }
+    }
+
+    bool CompileApplication(AST expr, uint32_t dst, bool tail) {
+        auto head = As<Cell>(expr)->GetFirst();
+        ArgsVec args;
+        AST rest = As<Cell>(expr)->GetSecond();
+        for (; Is<Cell>(rest); rest = As<Cell>(rest)->GetSecond()) {
+            args.push_back(As<Cell>(rest)->GetFirst());
+        }
+        // Improper applications and missing functions are errors, which the evaluator reports.
+        if (rest || !head || dst + args.size() + 1 >= kMaxRegisters) {
+            return false;
+        }
+        if (auto symbol = As<Symbol>(head); symbol && CompileBuiltin(symbol, args, dst)) {
+            return true;
+        }
+        Compile(head, dst, false);
+        auto prepare = Emit(Opcode::kPrepareCall, dst, AddSite(args, nullptr));
+        for (size_t i = 0; i < args.size(); ++i) {
+            Compile(args[i], dst + 1 + i, false);
+        }
+        Emit(tail ? Opcode::kTailCall : Opcode::kCall, dst, args.size());
+        code_->instructions[prepare].c = Here();
+        return true;
+    }
+
+    // Forms which have an original expression only run their code while their keyword is not
+    // bound by the program.
+    void CompileSpecialForm(SpecialForm* form, uint32_t dst, bool tail) {
+        std::optional<uint32_t> check;
+        if (form->GetForm()) {
+            check = Emit(Opcode::kCheckForm, dst, AddConstant(form));
+        }
+        if (Is<Lambda>(form)) {
+            Emit(Opcode::kMakeClosure, dst, AddConstant(form));
+        } else if (auto quote = As<QuoteForm>(form)) {
+            Emit(Opcode::kLoadConst, dst, AddConstant(quote->GetDatum()));
+        } else if (auto if_form = As<IfForm>(form)) {
+            Compile(if_form->GetCondition(), dst, false);
+            auto to_else = Emit(Opcode::kJumpIfFalse, dst);
+            Compile(if_form->GetConsequent(), dst, tail);
+            auto to_end = Emit(Opcode::kJump);
+            code_->instructions[to_else].b = Here();
+            Compile(if_form->GetAlternative(), dst, tail);
+            code_->instructions[to_end].b = Here();
+        } else if (auto and_form = As<AndForm>(form)) {
+            const auto& args = and_form->GetArgs();
+            auto stop = and_form->GetStopValue();
+            if (args.empty()) {
+                Emit(Opcode::kLoadConst, dst, AddConstant(heap_.GetBoolean(!stop)));
+            } else {
+                std::vector<uint32_t> exits;
+                for (size_t i = 0; i + 1 < args.size(); ++i) {
+                    Compile(args[i], dst, false);
+                    exits.push_back(Emit(stop ? Opcode::kJumpIfTrue : Opcode::kJumpIfFalse, dst));
+                }
+                Compile(args.back(), dst, tail);
+                for (auto exit : exits) {
+                    code_->instructions[exit].b = Here();
+                }
+            }
+        } else {
+            auto define = As<DefineForm>(form);
+            auto is_set = Is<SetForm>(form);
+            Compile(define->GetValue(), dst, false);
+            if (auto ref = As<LocalRef>(define->GetTarget())) {
+                Emit(is_set ? Opcode::kSetLocal : Opcode::kDefineLocal, dst, ref->GetDepth(),
+                     ref->GetSlot());
+            } else {
+                Emit(is_set ? Opcode::kSetGlobal : Opcode::kDefineGlobal, dst,
+                     AddConstant(define->GetTarget()));
+            }
+            Emit(Opcode::kLoadConst, dst, AddConstant(nullptr));
+        }
+        if (check) {
+            code_->instructions[*check].c = Here();
+        }
+    }
+
+    // Specialized code for applications of arithmetic, guarded by a check that the name still
+    // refers to the builtin when the code runs.
+    bool CompileBuiltin(Symbol* head, const ArgsVec& args, uint32_t dst) {
+        for (size_t i = 0; i < kBinaryBuiltins.size(); ++i) {
+            if (head == binary_[i] && args.size() == 2) {
+                auto guard = EmitGuard(head, args, dst, kBinaryBuiltins[i].func);
+                Compile(args[0], dst, false);
+                Compile(args[1], dst + 1, false);
+                Emit(kBinaryBuiltins[i].op, dst, dst, dst + 1);
+                code_->instructions[guard].c = Here();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t EmitGuard(Symbol* head, const ArgsVec& args, uint32_t dst, NativeFunc func) {
+        Emit(Opcode::kLoadGlobal, dst, AddConstant(head), AddGlobal());
+        return Emit(Opcode::kGuard, dst, AddSite(args, func));
+    }
+
+    uint32_t Emit(Opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        code_->instructions.push_back({op, a, b, c});
+        return code_->instructions.size() - 1;
+    }
+
+    uint32_t Here() const {
+        return code_->instructions.size();
+    }
+
+    uint32_t AddConstant(AST constant) {
+        code_->constants.push_back(constant);
+        return code_->constants.size() - 1;
+    }
+
+    uint32_t AddGlobal() {
+        code_->globals.push_back(nullptr);
+        return code_->globals.size() - 1;
+    }
+
+    uint32_t AddSite(const ArgsVec& args, NativeFunc func) {
+        code_->sites.push_back({args, func});
+        return code_->sites.size() - 1;
+    }
+
+    Heap& heap_;
+    std::unique_ptr<Bytecode> code_;
+    std::vector<Symbol*> binary_;
+};
+
+AST ApplyToSite(Dispatcher& frame, AST value, const CallSite& site) {
+    auto func = As<Function>(value);
+    if (!func) {
+        throw RuntimeError("This expression can't be used as a function");
+    }
+    return func->Apply(frame, site.args);
+}
+
+bool IsNative(AST value) {
+    auto func = As<InternalFunction>(value);
+    return func && func->IsNative();
+}
+
+bool IsBuiltin(AST value, const CallSite& site) {
+    auto func = As<InternalFunction>(value);
+    return func && func->GetNativeFunc() == site.func;
+}
+
+std::pair<int64_t, int64_t> ToIntegers(AST lhs, AST rhs) {
+    if (!Is<Number>(lhs) || !Is<Number>(rhs)) {
+        throw RuntimeError(kWrongArgs);
+    }
+    return {As<Number>(lhs)->GetValue(), As<Number>(rhs)->GetValue()};
+}
+
+// Looks the name up only when the cached binding may no longer be the one it resolves to.
+AST LoadGlobal(Dispatcher& frame, const Bytecode& code, const Instruction& instr) {
+    auto name = static_cast<Symbol*>(code.constants[instr.b]);
+    auto& binding = code.globals[instr.c];
+    if (binding && !name->IsFrameBound()) {
+        return binding->GetValue();
+    }
+    binding = name->IsFrameBound() ? nullptr : frame.FindGlobal(name);
+    return binding ? binding->GetValue() : frame.Resolve(name);
+}
+
+struct PendingCall {
+    CustomFunction* func;
+    const AST* args;
+    size_t count;
+};
+
+using Registers = std::array<AST, kMaxRegisters>;
+
+// The state of one call, shared by the interpreter and the machine code.
+struct CallState {
+    Dispatcher& frame;
+    Heap& heap;
+    EvalContext& context;
+    const Bytecode& code;
+    Registers& regs;
+    // A call in tail position is left here instead of being made.
+    PendingCall* next;
+    AST false_value;
+    AST result = nullptr;
+    // Raised by an instruction which the machine code has left to the interpreter.
+    std::exception_ptr error = nullptr;
+};
+
+// Runs instruction `pc` and returns the index of the next one, or kFinished once the call has
+// left its value in `result` or a pending call in `next`. The parts of `call` are passed on their
+// own, so that the loop of the interpreter can keep them in registers, and so is the opcode, so
+// that the helpers of the machine code only contain the code of their own instruction.
+[[gnu::always_inline]] inline uint32_t Step(CallState& call, Dispatcher& frame, Heap& heap,
+                                            const Bytecode& code, Registers& regs, uint32_t pc,
+                                            Opcode op) {
+    const auto& instr = code.instructions[pc];
+    switch (op) {
+        case Opcode::kLoadConst:
+            regs[instr.a] = code.constants[instr.b];
+            break;
+        case Opcode::kLoadLocal:
+            regs[instr.a] = frame.GetFrame(instr.b)->GetLocal(instr.c);
+            break;
+        case Opcode::kLoadGlobal:
+            regs[instr.a] = LoadGlobal(frame, code, instr);
+            break;
+        case Opcode::kMakeClosure:
+            regs[instr.a] = code.constants[instr.b]->Compute(frame);
+            break;
+        case Opcode::kDefineLocal:
+            frame.GetFrame(instr.b)->DefineLocal(instr.c, regs[instr.a]);
+            break;
+        case Opcode::kSetLocal:
+            frame.GetFrame(instr.b)->SetLocal(instr.c, regs[instr.a]);
+            break;
+        case Opcode::kDefineGlobal:
+            frame.Define(As<Symbol>(code.constants[instr.b]), regs[instr.a]);
+            break;
+        case Opcode::kSetGlobal:
+            frame.Set(As<Symbol>(code.constants[instr.b]), regs[instr.a]);
+            break;
+        case Opcode::kCheckForm:
+            if (auto form = static_cast<SpecialForm*>(code.constants[instr.b]);
+                form->IsShadowed()) {
+                regs[instr.a] = ComputeExpr(frame, form->GetForm());
+                return instr.c;
+            }
+            break;
+        case Opcode::kEval:
+            regs[instr.a] = ComputeExpr(frame, code.constants[instr.b]);
+            break;
+        case Opcode::kJump:
+            return instr.b;
+        case Opcode::kJumpIfFalse:
+            if (regs[instr.a] == call.false_value) {
+                return instr.b;
+            }
+            break;
+        case Opcode::kJumpIfTrue:
+            if (regs[instr.a] != call.false_value) {
+                return instr.b;
+            }
+            break;
+        case Opcode::kGuard:
+            if (!IsBuiltin(regs[instr.a], code.sites[instr.b])) {
+                regs[instr.a] = ApplyToSite(frame, regs[instr.a], code.sites[instr.b]);
+                return instr.c;
+            }
+            break;
+        case Opcode::kPrepareCall:
+            if (!Is<CustomFunction>(regs[instr.a]) && !IsNative(regs[instr.a])) {
+                regs[instr.a] = ApplyToSite(frame, regs[instr.a], code.sites[instr.b]);
+                return instr.c;
+            }
+            break;
+        case Opcode::kCall:
+            if (auto native = As<InternalFunction>(regs[instr.a])) {
+                regs[instr.a] = native->Call(frame, {&regs[instr.a + 1], instr.b});
+            } else {
+                regs[instr.a] = RunBytecode(static_cast<CustomFunction*>(regs[instr.a]),
+                                            &regs[instr.a + 1], instr.b);
+            }
+            break;
+        case Opcode::kTailCall:
+            if (auto native = As<InternalFunction>(regs[instr.a])) {
+                call.result = native->Call(frame, {&regs[instr.a + 1], instr.b});
+            } else {
+                *call.next = {static_cast<CustomFunction*>(regs[instr.a]), &regs[instr.a + 1],
+                              instr.b};
+            }
+            return kFinished;
+        case Opcode::kReturn:
+            call.result = regs[instr.a];
+            return kFinished;
+        case Opcode::kAdd: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = MakeNumber(heap, lhs + rhs);
+            break;
+        }
+        case Opcode::kSub: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = MakeNumber(heap, lhs - rhs);
+            break;
+        }
+        case Opcode::kMul: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = MakeNumber(heap, lhs * rhs);
+            break;
+        }
+        case Opcode::kDiv: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = MakeNumber(heap, lhs / rhs);
+            break;
+        }
+        case Opcode::kEqual: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = heap.GetBoolean(lhs == rhs);
+            break;
+        }
+        case Opcode::kLess: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = heap.GetBoolean(lhs < rhs);
+            break;
+        }
+        case Opcode::kGreater: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = heap.GetBoolean(lhs > rhs);
+            break;
+        }
+        case Opcode::kLessEqual: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = heap.GetBoolean(lhs <= rhs);
+            break;
+        }
+        case Opcode::kGreaterEqual: {
+            auto [lhs, rhs] = ToIntegers(regs[instr.b], regs[instr.c]);
+            regs[instr.a] = heap.GetBoolean(lhs >= rhs);
+            break;
+        }
+    }
+    return pc + 1;
+}
+
+void Execute(CallState& call, uint32_t pc) {
+    auto& frame = call.frame;
+    auto& heap = call.heap;
+    const auto& code = call.code;
+    auto& regs = call.regs;
+    while (pc != kFinished) {
+        pc = Step(call, frame, heap, code, regs, pc, code.instructions[pc].op);
+    }
+}
+
+template <Opcode op>
+uint32_t StepFromMachineCode(void* state, uint32_t pc) {
+    auto& call = *static_cast<CallState*>(state);
+    try {
+        return Step(call, call.frame, call.heap, call.code, call.regs, pc, op);
+    } catch (...) {
+        call.error = std::current_exception();
+        return kFinished;
+    }
+}
+
+template <size_t... ops>
+constexpr std::array<StepFunc, kOpcodeCount> MakeSteps(std::index_sequence<ops...>) {
+    return {&StepFromMachineCode<static_cast<Opcode>(ops)>...};
+}
+
+const std::array<StepFunc, kOpcodeCount> kSteps =
+    MakeSteps(std::make_index_sequence<kOpcodeCount>());
+
+// Runs the machine code of the lambda, compiling it once the lambda has been called often
+// enough. Returns the instruction at which the interpreter takes over, or kFinished.
+uint32_t RunMachineCode(CallState& call, Bytecode& code) {
+    auto& stats = call.context.GetJitStats();
+    if (++code.calls == call.context.GetJitThreshold()) {
+        code.machine_code = CompileMachineCode(code, kSteps.data());
+        stats.compiled += static_cast<bool>(code.machine_code);
+    }
+    if (!code.machine_code) {
+        return 0;
+    }
+    auto pc = code.machine_code.Run(&call, call.regs.data(), code.constants.data(),
+                                     call.false_value, call.heap.GetBoolean(true));
+    if (call.error) {
+        std::rethrow_exception(call.error);
+    }
+    stats.deopts += pc != kFinished;
+    return pc;
+}
+
+}  // namespace
+
+std::unique_ptr<Bytecode> CompileBytecode(Heap& heap, const ArgsVec& body) {
+    return BytecodeCompiler(heap).Compile(body);
+}
+
+AST RunBytecode(CustomFunction* func, const AST* args, size_t count) {
+    auto& heap = func->GetEnv()->GetHeap();
+    auto& context = func->GetEnv()->GetContext();
+    auto& stack = context.GetCallStack();
+    CallStack::Call depth{stack};
+    if (!stack.HasRoom()) {
+        return stack.Continue([&] { return RunBytecode(func, args, count); });
+    }
+    Registers regs;
+    PendingCall next{func, args, count};
+    while (true) {
+        auto lambda = next.func->GetLambda();
+        if (next.count != lambda->GetParamsCount()) {
+            throw RuntimeError(kWrongArgs);
+        }
+        FrameGuard guard{Dispatcher::EnterFrame(next.func->GetEnv(), lambda)};
+        for (size_t i = 0; i < next.count; ++i) {
+            guard.frame->DefineLocal(i, next.args[i]);
+        }
+        next.func = nullptr;
+        auto& code = lambda->GetCode();
+        CallState call{*guard.frame, heap, context, code, regs, &next, heap.GetBoolean(false)};
+        Execute(call, RunMachineCode(call, code));
+        if (!next.func) {
+            return call.result;
+        }
+    }
+}
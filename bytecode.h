@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <jit.h>
+#include <object.h>
+
+// Register machine code for the body of a lambda. Every call has its own registers; `a` names
+// the register an instruction writes to, unless stated otherwise.
+enum class Opcode : uint8_t {
+    kLoadConst,     // a = constants[b]
+    kLoadLocal,     // a = slot c of the frame b levels up
+    kLoadGlobal,    // a = value of the name constants[b], through the binding cached in globals[c]
+    kMakeClosure,   // a = closure of the lambda constants[b] over the current frame
+    kDefineLocal,   // slot c of the frame b levels up = a
+    kSetLocal,      // the same, for a slot which must already be bound
+    kDefineGlobal,  // the name constants[b] = a, in the scope of the current frame
+    kSetGlobal,     // the same, for a name which must already be bound
+    // If the keyword of the special form constants[b] has been bound by the program, a = the
+    // original form evaluated as an application, and the code continues at c.
+    kCheckForm,
+    kEval,         // a = constants[b] computed by the tree-walking evaluator
+    kJump,         // continue at b
+    kJumpIfFalse,  // continue at b if a is #f
+    kJumpIfTrue,   // continue at b unless a is #f
+    // Specializations of an application check that a holds the builtin of sites[b]. If it does
+    // not, a is applied to the unevaluated arguments of the site, and the code continues at c.
+    kGuard,
+    // The same, for calls which expect a custom function or a native builtin.
+    kPrepareCall,
+    kCall,      // a = function a called with the b arguments which follow it
+    kTailCall,  // the same, replacing the current call
+    kReturn,    // returns a
+    kAdd,       // a = b + c, and so on
+    kSub,
+    kMul,
+    kDiv,
+    kEqual,
+    kLess,
+    kGreater,
+    kLessEqual,
+    kGreaterEqual,
+};
+
+const size_t kOpcodeCount = static_cast<size_t>(Opcode::kGreaterEqual) + 1;
+
+struct Instruction {
+    Opcode op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+// The unevaluated arguments of an application, and the builtin its code was specialized for.
+struct CallSite {
+    ArgsVec args;
+    NativeFunc func = nullptr;
+};
+
+struct Bytecode {
+    std::vector<Instruction> instructions;
+    std::vector<AST> constants;
+    std::vector<CallSite> sites;
+    // The root bindings which kLoadGlobal has found, or nullptr until it has found one.
+    mutable std::vector<Binding*> globals;
+    // Calls made so far, and the machine code compiled once the lambda has turned out to be hot.
+    size_t calls = 0;
+    MachineCode machine_code;
+
+    void Trace(Tracer& tracer);
+};
+
+// Expressions which would need more registers are left to the tree-walking evaluator.
+const size_t kMaxRegisters = 64;
+
+std::unique_ptr<Bytecode> CompileBytecode(Heap& heap, const ArgsVec& body);
+
+// Calls `func` with computed arguments. Calls in tail position replace the current one, so that
+// iterative procedures run in constant native stack.
+AST RunBytecode(CustomFunction* func, const AST* args, size_t count);
@@ -0,0 +1,362 @@
+#include <compiler.h>
+
+#include <algorithm>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+
+#include <bytecode.h>
+#include <context.h>
+#include <internal_funcs.h>
+
+struct Scope {
+    const std::vector<Symbol*>& names;
+    const Scope* parent;
+    bool makes_closures = false;
+};
+
+namespace {
+
+struct Address {
+    uint32_t depth;
+    uint32_t slot;
+};
+
+std::optional<Address> Lookup(const Scope* scope, Symbol* name) {
+    for (uint32_t depth = 0; scope; scope = scope->parent, ++depth) {
+        const auto& names = scope->names;
+        // The last of repeated parameters is the one which gets bound.
+        for (auto i = names.size(); i > 0; --i) {
+            if (names[i - 1] == name) {
+                return Address{depth, static_cast<uint32_t>(i - 1)};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<ArgsVec> ToProperList(AST tree) {
+    ArgsVec res;
+    while (Is<Cell>(tree)) {
+        res.push_back(As<Cell>(tree)->GetFirst());
+        tree = As<Cell>(tree)->GetSecond();
+    }
+    if (tree) {
+        return std::nullopt;
+    }
+    return res;
+}
+
+std::optional<std::vector<Symbol*>> ToSymbols(const std::optional<ArgsVec>& list) {
+    if (!list) {
+        return std::nullopt;
+    }
+    std::vector<Symbol*> res;
+    res.reserve(list->size());
+    for (auto elem : *list) {
+        if (!Is<Symbol>(elem)) {
+            return std::nullopt;
+        }
+        res.push_back(As<Symbol>(elem));
+    }
+    return res;
+}
+
+// Builtins which neither depend on nor change anything but their arguments.
+bool IsPure(NativeFunc func) {
+    static const NativeFunc kPure[] = {FuncAdd,  FuncSub,     FuncMul,       FuncMin,
+                                       FuncMax,  FuncAbs,     FuncNot,       FuncEqual,
+                                       FuncLess, FuncGreater, FuncLessEqual, FuncGreaterEqual};
+    return std::find(std::begin(kPure), std::end(kPure), func) != std::end(kPure);
+}
+
+class Compiler {
+public:
+    explicit Compiler(Dispatcher& dispatcher)
+        : dispatcher_(dispatcher),
+          heap_(dispatcher.GetHeap()),
+          context_(dispatcher.GetContext()),
+          quote_(heap_.Intern("quote")),
+          lambda_(heap_.Intern("lambda")),
+          define_(heap_.Intern("define")),
+          set_(heap_.Intern("set!")),
+          if_(heap_.Intern("if")),
+          and_(heap_.Intern("and")),
+          or_(heap_.Intern("or")) {
+    }
+
+    Lambda* Compile(std::vector<Symbol*> params, const ArgsVec& body, const Scope* enclosing,
+                    Symbol* keyword = nullptr, AST form = nullptr) {
+        auto names = params;
+        for (auto expr : body) {
+            CollectDefinitions(expr, &names);
+        }
+        Scope scope{names, enclosing};
+        ArgsVec compiled;
+        compiled.reserve(body.size());
+        for (auto expr : body) {
+            compiled.push_back(Rewrite(expr, scope));
+        }
+        auto code = CompileBytecode(heap_, compiled);
+        return As<Lambda>(heap_.Make<Lambda>(std::move(names), params.size(), std::move(compiled),
+                                             scope.makes_closures, std::move(code), keyword,
+                                             form));
+    }
+
+    // Writes the outermost folded forms to the folding dump of the context, if it has one.
+    void DumpFolds() const {
+        auto dump = context_.GetFoldingDump();
+        if (!dump) {
+            return;
+        }
+        for (auto form : folds_) {
+            *dump << SerializeExpr(form->GetForm()) << " => " << SerializeExpr(form->GetValue())
+                  << '\n';
+        }
+    }
+
+private:
+    // Finds the names which the body may define in its own frame. Nested lambdas get frames of
+    // their own, and quoted data is never evaluated.
+    void CollectDefinitions(AST expr, std::vector<Symbol*>* names) {
+        auto cell = As<Cell>(expr);
+        if (!cell) {
+            return;
+        }
+        auto head = cell->GetFirst();
+        if (head == quote_ || head == lambda_) {
+            return;
+        }
+        AST rest = expr;
+        if (head == define_ && Is<Cell>(cell->GetSecond())) {
+            auto target = As<Cell>(cell->GetSecond())->GetFirst();
+            if (auto signature = As<Cell>(target)) {
+                AddName(signature->GetFirst(), names);
+                return;
+            }
+            AddName(target, names);
+            rest = As<Cell>(cell->GetSecond())->GetSecond();
+        }
+        for (; Is<Cell>(rest); rest = As<Cell>(rest)->GetSecond()) {
+            CollectDefinitions(As<Cell>(rest)->GetFirst(), names);
+        }
+    }
+
+    static void AddName(AST name, std::vector<Symbol*>* names) {
+        auto symbol = As<Symbol>(name);
+        if (symbol && std::find(names->begin(), names->end(), symbol) == names->end()) {
+            names->push_back(symbol);
+        }
+    }
+
+    AST Rewrite(AST expr, Scope& scope) {
+        if (auto symbol = As<Symbol>(expr)) {
+            return Reference(symbol, scope);
+        }
+        // Only forms built at run time, like the arguments of an alias of lambda, can contain
+        // references compiled for another frame.
+        if (auto ref = As<LocalRef>(expr)) {
+            return Reference(ref->GetName(), scope);
+        }
+        auto cell = As<Cell>(expr);
+        if (!cell) {
+            return expr;
+        }
+        auto head = As<Symbol>(cell->GetFirst());
+        if (head && !head->IsUserBound() && !Lookup(&scope, head)) {
+            if (auto form = RewriteSpecialForm(head, expr, scope)) {
+                return form;
+            }
+            auto call = RewriteList(expr, scope);
+            if (auto folded = context_.UsesFolding() ? Fold(head, expr, call) : nullptr) {
+                return folded;
+            }
+            return call;
+        }
+        return RewriteList(expr, scope);
+    }
+
+    // Computes the call of a pure builtin whose arguments are constants. Calls which fail are
+    // left as they are, to report the error at run time.
+    AST Fold(Symbol* head, AST expr, AST call) {
+        auto args = ToProperList(As<Cell>(call)->GetSecond());
+        if (!args) {
+            return nullptr;
+        }
+        std::vector<Symbol*> names{head};
+        size_t nested = 0;
+        for (auto& arg : *args) {
+            if (auto folded = As<FoldedForm>(arg)) {
+                names.insert(names.end(), folded->GetNames().begin(), folded->GetNames().end());
+                arg = folded->GetValue();
+                ++nested;
+            } else if (auto quote = As<QuoteForm>(arg)) {
+                names.push_back(quote_);
+                arg = quote->GetDatum();
+            } else if (!IsFixnum(arg) && !Is<Number>(arg) && !Is<Boolean>(arg)) {
+                return nullptr;
+            }
+        }
+        AST value;
+        try {
+            auto func = As<InternalFunction>(dispatcher_.Resolve(head));
+            if (!func || !func->IsNative() || !IsPure(func->GetNativeFunc())) {
+                return nullptr;
+            }
+            value = func->GetNativeFunc()(dispatcher_, *args);
+        } catch (const std::runtime_error&) {
+            return nullptr;
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        // Folded arguments are the last forms folded, and are now part of this one.
+        folds_.resize(folds_.size() - nested);
+        auto folded = As<FoldedForm>(heap_.Make<FoldedForm>(expr, value, std::move(names)));
+        folds_.push_back(folded);
+        return folded;
+    }
+
+    // Lowers the form into a node of its own. Malformed forms are returned as they are, and
+    // nullptr if `head` is no keyword.
+    AST RewriteSpecialForm(Symbol* head, AST expr, Scope& scope) {
+        if (!IsKeyword(head)) {
+            return nullptr;
+        }
+        auto list = ToProperList(expr);
+        if (!list) {
+            return expr;
+        }
+        ArgsVec args(list->begin() + 1, list->end());
+        if (head == quote_) {
+            if (args.size() != 1) {
+                return expr;
+            }
+            return heap_.Make<QuoteForm>(head, expr, args[0]);
+        }
+        if (head == if_) {
+            if (args.size() != 2 && args.size() != 3) {
+                return expr;
+            }
+            auto condition = Rewrite(args[0], scope);
+            auto consequent = Rewrite(args[1], scope);
+            auto alternative = args.size() == 3 ? Rewrite(args[2], scope) : nullptr;
+            return heap_.Make<IfForm>(head, expr, condition, consequent, alternative);
+        }
+        if (head == and_ || head == or_) {
+            for (auto& arg : args) {
+                arg = Rewrite(arg, scope);
+            }
+            if (head == and_) {
+                return heap_.Make<AndForm>(head, expr, std::move(args));
+            }
+            return heap_.Make<OrForm>(head, expr, std::move(args));
+        }
+        if (head == lambda_) {
+            return RewriteLambda(expr, args, scope);
+        }
+        if (head == define_) {
+            return RewriteDefine(expr, args, scope);
+        }
+        if (args.size() != 2 || !Is<Symbol>(args[0])) {
+            return expr;
+        }
+        return heap_.Make<SetForm>(head, expr, Reference(As<Symbol>(args[0]), scope),
+                                   Rewrite(args[1], scope));
+    }
+
+    bool IsKeyword(Symbol* name) const {
+        return name == quote_ || name == lambda_ || name == define_ || name == set_ ||
+               name == if_ || name == and_ || name == or_;
+    }
+
+    AST Reference(Symbol* name, const Scope& scope) {
+        auto address = Lookup(&scope, name);
+        if (!address) {
+            return name;
+        }
+        return heap_.Make<LocalRef>(address->depth, address->slot, name);
+    }
+
+    AST RewriteLambda(AST expr, const ArgsVec& args, Scope& scope) {
+        if (args.size() < 2) {
+            return expr;
+        }
+        auto params = ToSymbols(ToProperList(args[0]));
+        if (!params) {
+            return expr;
+        }
+        scope.makes_closures = true;
+        return Compile(std::move(*params), ArgsVec(args.begin() + 1, args.end()), &scope, lambda_,
+                       expr);
+    }
+
+    AST RewriteDefine(AST expr, const ArgsVec& args, Scope& scope) {
+        if (args.size() < 2) {
+            return expr;
+        }
+        if (auto name = As<Symbol>(args[0])) {
+            if (args.size() != 2) {
+                return expr;
+            }
+            return heap_.Make<DefineForm>(define_, expr, Reference(name, scope),
+                                          Rewrite(args[1], scope));
+        }
+        auto names = ToSymbols(ToProperList(args[0]));
+        if (!names || names->empty()) {
+            return expr;
+        }
+        scope.makes_closures = true;
+        auto lambda = Compile(std::vector<Symbol*>(names->begin() + 1, names->end()),
+                              ArgsVec(args.begin() + 1, args.end()), &scope);
+        return heap_.Make<DefineForm>(define_, expr, Reference(names->front(), scope), lambda);
+    }
+
+    // Shares the original cells unless some element has changed.
+    AST RewriteList(AST expr, Scope& scope) {
+        ArgsVec elements;
+        bool changed = false;
+        AST tail = expr;
+        for (; Is<Cell>(tail); tail = As<Cell>(tail)->GetSecond()) {
+            auto elem = As<Cell>(tail)->GetFirst();
+            elements.push_back(Rewrite(elem, scope));
+            changed |= elements.back() != elem;
+        }
+        if (!changed) {
+            return expr;
+        }
+        return MakeList(elements, tail);
+    }
+
+    AST MakeList(const ArgsVec& elements, AST tail = nullptr) {
+        AST res = tail;
+        for (auto it = elements.rbegin(); it != elements.rend(); ++it) {
+            auto cell = As<Cell>(heap_.Make<Cell>());
+            cell->SetFirst(*it);
+            cell->SetSecond(res);
+            res = cell;
+        }
+        return res;
+    }
+
+    Dispatcher& dispatcher_;
+    Heap& heap_;
+    EvalContext& context_;
+    std::vector<FoldedForm*> folds_;
+    Symbol* quote_;
+    Symbol* lambda_;
+    Symbol* define_;
+    Symbol* set_;
+    Symbol* if_;
+    Symbol* and_;
+    Symbol* or_;
+};
+
+}  // namespace
+
+Lambda* CompileLambda(Dispatcher& dispatcher, std::vector<Symbol*> params, const ArgsVec& body,
+                      const Scope* enclosing) {
+    Compiler compiler(dispatcher);
+    auto lambda = compiler.Compile(std::move(params), body, enclosing);
+    compiler.DumpFolds();
+    return lambda;
+}
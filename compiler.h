@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include <object.h>
+
+struct Scope;
+
+// Resolves every reference to a parameter or a local definition of the lambda (and of the
+// lambdas nested into it) to a frame depth and a slot. Other names, including the ones of
+// enclosing scopes which are not lambdas themselves, are still looked up by name at run time.
+// Special forms whose keyword is neither a local nor bound by the program are lowered into
+// SpecialForm nodes. Malformed forms are left as they are, so that evaluating them reports the
+// usual error. Calls of pure builtins over constants are folded into their values, which are
+// computed with `dispatcher`.
+Lambda* CompileLambda(Dispatcher& dispatcher, std::vector<Symbol*> params, const ArgsVec& body,
+                      const Scope* enclosing = nullptr);
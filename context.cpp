@@ -0,0 +1,18 @@
+#include <context.h>
+
+void EvalContext::SetBytecode(bool enabled) {
+    bytecode_ = enabled;
+}
+
+void EvalContext::SetFolding(bool enabled, std::ostream* dump) {
+    folding_ = enabled;
+    folding_dump_ = dump;
+}
+
+void EvalContext::SetJitThreshold(size_t calls) {
+    jit_threshold_ = calls;
+}
+
+void EvalContext::SetMaxDepth(size_t calls) {
+    call_stack_.SetMaxDepth(calls);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+
+#include <heap.h>
+#include <stack.h>
+
+class Object;
+
+const size_t kJitThreshold = 100;
+
+struct JitStats {
+    // Lambdas compiled to machine code.
+    size_t compiled = 0;
+    // Calls whose machine code left the rest of the call to the VM.
+    size_t deopts = 0;
+};
+
+// The state of the evaluators of one interpreter: how lambdas run, and the stacks of the calls
+// in progress. Every Dispatcher refers to the context of its interpreter next to the heap.
+class EvalContext {
+public:
+    EvalContext() = default;
+    EvalContext(const EvalContext&) = delete;
+    EvalContext& operator=(const EvalContext&) = delete;
+
+    // Computed arguments of the native builtin calls in progress. Like the locals of the
+    // evaluator, they are only used between safepoints and are no roots.
+    RawVector<Object*>& GetArgumentStack() {
+        return arguments_;
+    }
+
+    // Lambda bodies run on the bytecode VM unless this is turned off, which leaves them to the
+    // tree-walking evaluator.
+    void SetBytecode(bool enabled);
+    bool UsesBytecode() const {
+        return bytecode_;
+    }
+
+    // Calls of pure builtins over constants in lambda bodies are computed once, when the lambda
+    // is compiled, unless this is turned off. Every form folded is written to `dump` along with
+    // its value, if it is set.
+    void SetFolding(bool enabled, std::ostream* dump = nullptr);
+    bool UsesFolding() const {
+        return folding_;
+    }
+    std::ostream* GetFoldingDump() const {
+        return folding_dump_;
+    }
+
+    // Lambdas run on the VM are compiled to machine code on their `calls`-th call, if the build
+    // has the JIT. Zero leaves every lambda to the VM.
+    void SetJitThreshold(size_t calls);
+    size_t GetJitThreshold() const {
+        return jit_threshold_;
+    }
+    JitStats& GetJitStats() {
+        return jit_stats_;
+    }
+
+    // Calls of lambdas nest at most `calls` deep, whatever the size of the native stack; deeper
+    // ones raise RuntimeError.
+    void SetMaxDepth(size_t calls);
+    CallStack& GetCallStack() {
+        return call_stack_;
+    }
+
+private:
+    RawVector<Object*> arguments_;
+    bool bytecode_ = true;
+    bool folding_ = true;
+    std::ostream* folding_dump_ = nullptr;
+    size_t jit_threshold_ = kJitThreshold;
+    JitStats jit_stats_;
+    CallStack call_stack_;
+};
@@ -0,0 +1,763 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include <heap.h>
+#include <object.h>
+
+struct SlabPool::Page {
+    static const size_t kMaxSlots = kPageSize / kSlotGranularity;
+    static const size_t kBitsPerWord = 64;
+
+    bool IsUsed(size_t index) const {
+        return used[index / kBitsPerWord] >> (index % kBitsPerWord) & 1;
+    }
+    void SetUsed(size_t index, bool value) {
+        auto mask = uint64_t{1} << (index % kBitsPerWord);
+        if (value) {
+            used[index / kBitsPerWord] |= mask;
+        } else {
+            used[index / kBitsPerWord] &= ~mask;
+        }
+    }
+
+    Heap* owner;
+    Page* next;
+    size_t live;
+    // Left by SweepPage for the reclaiming step.
+    size_t dead;
+    FreeSlot* swept;
+    FreeSlot* swept_tail;
+    uint64_t used[kMaxSlots / kBitsPerWord];
+
+    static const size_t kHeaderSize;
+};
+
+static_assert(offsetof(SlabPool::Page, owner) == 0);
+
+const size_t SlabPool::Page::kHeaderSize =
+    (sizeof(SlabPool::Page) + kSlotGranularity - 1) / kSlotGranularity * kSlotGranularity;
+
+SlabPool::~SlabPool() {
+    ReleaseAll();
+}
+
+void SlabPool::Init(size_t slot_size, Heap* owner) {
+    owner_ = owner;
+    slot_size_ = slot_size;
+    slots_per_page_ = (kPageSize - Page::kHeaderSize) / slot_size;
+}
+
+SlabPool::Page* SlabPool::AllocatePage() {
+    auto page = static_cast<Page*>(std::aligned_alloc(kPageSize, kPageSize));
+    if (!page) {
+        throw std::bad_alloc();
+    }
+    page->owner = owner_;
+    page->next = pages_;
+    page->live = 0;
+    std::fill(std::begin(page->used), std::end(page->used), 0);
+    pages_ = page;
+    if (sweep_link_ == &pages_) {
+        // Fresh pages hold nothing to sweep, keep them ahead of the sweeper.
+        sweep_link_ = &page->next;
+    }
+    for (size_t i = slots_per_page_; i-- > 0;) {
+        auto slot = reinterpret_cast<FreeSlot*>(SlotAt(page, i));
+        slot->next = free_list_;
+        free_list_ = slot;
+    }
+    return page;
+}
+
+SlabPool::Page* SlabPool::PageOf(void* slot) const {
+    return reinterpret_cast<Page*>(reinterpret_cast<uintptr_t>(slot) & ~(kPageSize - 1));
+}
+
+std::byte* SlabPool::SlotAt(Page* page, size_t index) const {
+    return reinterpret_cast<std::byte*>(page) + Page::kHeaderSize + index * slot_size_;
+}
+
+size_t SlabPool::IndexOf(Page* page, void* slot) const {
+    return (static_cast<std::byte*>(slot) - SlotAt(page, 0)) / slot_size_;
+}
+
+void* SlabPool::Allocate() {
+    if (!free_list_) {
+        AllocatePage();
+    }
+    auto slot = free_list_;
+    free_list_ = slot->next;
+    auto page = PageOf(slot);
+    page->SetUsed(IndexOf(page, slot), true);
+    ++page->live;
+    ++live_slots_;
+    return slot;
+}
+
+void SlabPool::Deallocate(void* slot) {
+    auto page = PageOf(slot);
+    page->SetUsed(IndexOf(page, slot), false);
+    --page->live;
+    --live_slots_;
+    if (IsSweeping()) {
+        // The page might not have been swept yet, and that would list the slot twice.
+        return;
+    }
+    auto free_slot = static_cast<FreeSlot*>(slot);
+    free_slot->next = free_list_;
+    free_list_ = free_slot;
+}
+
+void SlabPool::StartSweep() {
+    free_list_ = nullptr;
+    sweep_link_ = &pages_;
+}
+
+bool SlabPool::IsSweeping() const {
+    return sweep_link_ && *sweep_link_;
+}
+
+template <class IsLive>
+void SlabPool::SweepPage(Page* page, IsLive&& is_live) const {
+    page->dead = 0;
+    page->swept = page->swept_tail = nullptr;
+    for (size_t i = slots_per_page_; i-- > 0;) {
+        auto slot = SlotAt(page, i);
+        if (page->IsUsed(i)) {
+            auto obj = std::launder(reinterpret_cast<Object*>(slot));
+            if (is_live(obj)) {
+                continue;
+            }
+            obj->~Object();
+            page->SetUsed(i, false);
+            --page->live;
+            ++page->dead;
+        }
+        auto free_slot = reinterpret_cast<FreeSlot*>(slot);
+        free_slot->next = page->swept;
+        page->swept = free_slot;
+        if (!page->swept_tail) {
+            page->swept_tail = free_slot;
+        }
+    }
+}
+
+void SlabPool::ReclaimNext() {
+    auto page = *sweep_link_;
+    live_slots_ -= page->dead;
+    if (page->live == 0) {
+        *sweep_link_ = page->next;
+        std::free(page);
+        return;
+    }
+    if (page->swept) {
+        page->swept_tail->next = free_list_;
+        free_list_ = page->swept;
+    }
+    sweep_link_ = &page->next;
+}
+
+template <class IsLive>
+size_t SlabPool::SweepStep(IsLive&& is_live, size_t budget) {
+    size_t work = 0;
+    while (IsSweeping() && work < budget) {
+        SweepPage(*sweep_link_, is_live);
+        ReclaimNext();
+        work += slots_per_page_;
+    }
+    if (!IsSweeping()) {
+        sweep_link_ = nullptr;
+    }
+    return work;
+}
+
+void SlabPool::ListPages(RawVector<Page*>* pages) const {
+    for (auto page = pages_; page; page = page->next) {
+        pages->push_back(page);
+    }
+}
+
+void SlabPool::ReclaimSwept() {
+    while (IsSweeping()) {
+        ReclaimNext();
+    }
+    sweep_link_ = nullptr;
+}
+
+void SlabPool::ReleaseAll() {
+    while (pages_) {
+        auto page = pages_;
+        pages_ = page->next;
+        for (size_t i = 0; i < slots_per_page_; ++i) {
+            if (page->IsUsed(i)) {
+                std::launder(reinterpret_cast<Object*>(SlotAt(page, i)))->~Object();
+            }
+        }
+        std::free(page);
+    }
+    free_list_ = nullptr;
+    sweep_link_ = nullptr;
+    live_slots_ = 0;
+}
+
+size_t SlabPool::LiveBytes() const {
+    return live_slots_ * slot_size_;
+}
+
+Nursery::~Nursery() {
+    Reset();
+    std::free(begin_);
+}
+
+void Nursery::Init(size_t capacity) {
+    Reset();
+    std::free(begin_);
+    begin_ = top_ = nullptr;
+    capacity_ = 0;
+    if (capacity == 0) {
+        return;
+    }
+    begin_ = static_cast<std::byte*>(std::aligned_alloc(kSlotGranularity, capacity));
+    if (!begin_) {
+        throw std::bad_alloc();
+    }
+    top_ = begin_;
+    capacity_ = capacity;
+}
+
+void Nursery::Reset() {
+    for (auto cur = begin_; cur != top_;) {
+        auto header = reinterpret_cast<Header*>(cur);
+        if (header->state == State::kLive) {
+            static_cast<Object*>(header->Body())->~Object();
+        }
+        cur += header->size;
+    }
+    top_ = begin_;
+}
+
+// Moves every young object it is shown into the old space and leaves a forwarding address
+// behind. Moved objects are queued, since their own fields may still point into the nursery.
+class Heap::Evacuator : public Tracer {
+public:
+    explicit Evacuator(Heap& heap) : heap_(heap) {
+    }
+
+    void Visit(AST& slot) override {
+        if (!IsHeapObject(slot) || !heap_.nursery_.Contains(slot)) {
+            return;
+        }
+        auto header = Nursery::HeaderOf(slot);
+        if (header->state != Nursery::State::kForwarded) {
+            auto moved = header->promote(heap_, slot);
+            slot->~Object();
+            header->forward = moved;
+            header->state = Nursery::State::kForwarded;
+            pending_.push_back(moved);
+        }
+        slot = header->forward;
+    }
+
+    void Drain() {
+        while (!pending_.empty()) {
+            auto obj = pending_.back();
+            pending_.pop_back();
+            obj->Trace(*this);
+        }
+    }
+
+private:
+    Heap& heap_;
+    RawVector<Object*> pending_;
+};
+
+class Heap::Shader : public Tracer {
+public:
+    explicit Shader(Heap& heap) : heap_(heap) {
+    }
+
+    void Visit(AST& slot) override {
+        heap_.Shade(slot);
+    }
+
+private:
+    Heap& heap_;
+};
+
+namespace {
+class PauseTimer {
+public:
+    explicit PauseTimer(GcStats& stats)
+        : stats_(stats), start_(std::chrono::steady_clock::now()) {
+    }
+    ~PauseTimer() {
+        stats_.max_pause = std::max<std::chrono::nanoseconds>(
+            stats_.max_pause, std::chrono::steady_clock::now() - start_);
+    }
+
+private:
+    GcStats& stats_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(std::chrono::nanoseconds* duration)
+        : duration_(duration), start_(std::chrono::steady_clock::now()) {
+    }
+    ~PhaseTimer() {
+        *duration_ = std::chrono::steady_clock::now() - start_;
+    }
+
+private:
+    std::chrono::nanoseconds* duration_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Calls func(0) .. func(count - 1), each on its own thread; the first one on the caller's.
+template <class Func>
+void RunOnThreads(size_t count, Func&& func) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < count; ++i) {
+        threads.emplace_back(func, i);
+    }
+    func(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+}  // namespace
+
+// Work-stealing marker for stop-the-world cycles. Each worker traces from a private stack and
+// moves the surplus to its shared deque, where idle workers can steal it. Marking is over once
+// all of them are idle, since an idle worker holds no work and never produces any.
+class Heap::ParallelMarker {
+    static const size_t kPublishThreshold = 64;
+
+    struct Deque {
+        std::mutex lock;
+        RawVector<Object*> items;
+        std::atomic<size_t> size = 0;
+    };
+
+    class Worker : public Tracer {
+    public:
+        Worker(ParallelMarker& marker, size_t index) : marker_(marker), index_(index) {
+        }
+
+        void Visit(AST& slot) override {
+            if (marker_.heap_.TryMark(slot)) {
+                local_.push_back(slot);
+            }
+        }
+
+        void Run() {
+            do {
+                while (!local_.empty()) {
+                    auto obj = local_.back();
+                    local_.pop_back();
+                    obj->Trace(*this);
+                    if (local_.size() > kPublishThreshold) {
+                        Publish();
+                    }
+                }
+            } while (Refill());
+        }
+
+    private:
+        void Publish() {
+            auto& deque = marker_.deques_[index_];
+            auto half = local_.begin() + local_.size() / 2;
+            std::lock_guard guard(deque.lock);
+            deque.items.insert(deque.items.end(), local_.begin(), half);
+            deque.size = deque.items.size();
+            local_.erase(local_.begin(), half);
+        }
+
+        bool Steal(Deque& deque, bool all) {
+            if (deque.size == 0) {
+                return false;
+            }
+            std::lock_guard guard(deque.lock);
+            auto count = all ? deque.items.size() : (deque.items.size() + 1) / 2;
+            local_.insert(local_.end(), deque.items.end() - count, deque.items.end());
+            deque.items.resize(deque.items.size() - count);
+            deque.size = deque.items.size();
+            return count > 0;
+        }
+
+        bool TryAll() {
+            auto& deques = marker_.deques_;
+            for (size_t i = 0; i < deques.size(); ++i) {
+                auto victim = (index_ + i) % deques.size();
+                if (Steal(deques[victim], victim == index_)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool Refill() {
+            if (TryAll()) {
+                return true;
+            }
+            auto& idle = marker_.idle_;
+            ++idle;
+            while (idle != marker_.deques_.size()) {
+                for (auto& deque : marker_.deques_) {
+                    if (deque.size == 0) {
+                        continue;
+                    }
+                    --idle;
+                    if (TryAll()) {
+                        return true;
+                    }
+                    ++idle;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            return false;
+        }
+
+        ParallelMarker& marker_;
+        size_t index_;
+        RawVector<Object*> local_;
+    };
+
+public:
+    ParallelMarker(Heap& heap, size_t threads) : heap_(heap), deques_(threads) {
+    }
+
+    void Run(RawVector<Object*>* gray) {
+        deques_[0].items.swap(*gray);
+        deques_[0].size = deques_[0].items.size();
+        RunOnThreads(deques_.size(), [this](size_t index) { Worker(*this, index).Run(); });
+    }
+
+private:
+    Heap& heap_;
+    RawVector<Deque> deques_;
+    std::atomic<size_t> idle_ = 0;
+};
+
+Heap::Heap() {
+    for (size_t i = 0; i < kSizeClassCount; ++i) {
+        pools_[i].Init((i + 1) * kSlotGranularity, this);
+    }
+    booleans_ = {Construct<Boolean>(false), Construct<Boolean>(true)};
+    SetGenerational(true);
+}
+
+Symbol* Heap::Intern(std::string_view name) {
+    auto iter = symbols_.find(name);
+    if (iter != symbols_.end()) {
+        return iter->second;
+    }
+    auto symbol = static_cast<Symbol*>(Construct<Symbol>(std::string(name), next_symbol_id_++));
+    symbols_.emplace(symbol->GetName(), symbol);
+    return symbol;
+}
+
+void Heap::SetGenerational(bool generational) {
+    if (generational == generational_) {
+        return;
+    }
+    CollectNursery();
+    nursery_.Init(generational ? kNurserySize : 0);
+    generational_ = generational;
+}
+
+void Heap::SetIncremental(size_t slice_budget) {
+    slice_budget_ = slice_budget;
+    allocations_until_slice_ = slice_budget;
+}
+
+void Heap::SetPolicy(const GcPolicy& policy) {
+    policy_ = policy;
+    major_threshold_ = policy.min_threshold;
+}
+
+void Heap::SetParallelism(size_t threads) {
+    threads_ = std::max<size_t>(threads, 1);
+}
+
+void Heap::RequestCollection() {
+    collection_requested_ = true;
+}
+
+const GcStats& Heap::GetStats() const {
+    return stats_;
+}
+
+void Heap::Remember(Object* obj) {
+    if (!obj->remembered_) {
+        obj->remembered_ = true;
+        remembered_.push_back(obj);
+    }
+}
+
+void Heap::AdmitOld(Object* obj) {
+    // Objects created during a cycle must survive it. While marking they are blackened right
+    // away, since they may have been initialized with references nobody has visited yet.
+    obj->old_ = true;
+    obj->mark_epoch_ = epoch_;
+    if (phase_ == Phase::kMarking) {
+        Shader shader(*this);
+        obj->Trace(shader);
+    }
+}
+
+void Heap::Shade(Object* obj) {
+    if (!IsHeapObject(obj) || nursery_.Contains(obj) || obj->mark_epoch_ == epoch_) {
+        return;
+    }
+    obj->mark_epoch_ = epoch_;
+    gray_.push_back(obj);
+}
+
+bool Heap::TryMark(Object* obj) {
+    if (!IsHeapObject(obj) || nursery_.Contains(obj)) {
+        return false;
+    }
+    std::atomic_ref<uint8_t> mark(obj->mark_epoch_);
+    return mark.load(std::memory_order_relaxed) != epoch_ &&
+           mark.exchange(epoch_, std::memory_order_relaxed) != epoch_;
+}
+
+void Heap::ShadeStored(Object* holder, Object* value) {
+    if (!nursery_.Contains(holder) && holder->mark_epoch_ == epoch_) {
+        Shade(value);
+    }
+}
+
+void Heap::OnAllocation() {
+    if (allocations_until_slice_ > 0) {
+        --allocations_until_slice_;
+        return;
+    }
+    allocations_until_slice_ = slice_budget_;
+    PauseTimer timer(stats_);
+    if (phase_ == Phase::kMarking) {
+        // Finishing the mark needs the precise roots of Clean; until then only trace.
+        MarkSlice(slice_budget_);
+    } else {
+        SweepSlice(slice_budget_);
+    }
+}
+
+void Heap::CollectNursery() {
+    if (nursery_.IsEmpty()) {
+        return;
+    }
+    Evacuator evacuator(*this);
+    for (auto obj : remembered_) {
+        obj->remembered_ = false;
+        obj->Trace(evacuator);
+        evacuator.Drain();
+    }
+    remembered_.clear();
+    nursery_.Reset();
+    ++stats_.minor_collections;
+}
+
+size_t Heap::OldBytes() const {
+    size_t bytes = 0;
+    for (const auto& pool : pools_) {
+        bytes += pool.LiveBytes();
+    }
+    return bytes;
+}
+
+size_t Heap::GetLiveBytes() const {
+    // Spare frames are made in the old space by MakeOld, and so take a slot each.
+    return OldBytes() - spare_frames_.size() * (kSizeClass<Dispatcher> + 1) * kSlotGranularity;
+}
+
+void Heap::StartCycle(Dispatcher* root) {
+    allocated_bytes_ = 0;
+    ++epoch_;
+    phase_ = Phase::kMarking;
+    Shade(root);
+    for (auto obj : booleans_) {
+        Shade(obj);
+    }
+    for (auto frame : spare_frames_) {
+        Shade(frame);
+    }
+}
+
+void Heap::PruneSymbols() {
+    std::erase_if(symbols_, [this](const auto& entry) {
+        return static_cast<Object*>(entry.second)->mark_epoch_ != epoch_;
+    });
+}
+
+void Heap::StartSweep() {
+    PruneSymbols();
+    phase_ = Phase::kSweeping;
+    sweep_pool_ = 0;
+    pools_[0].StartSweep();
+}
+
+bool Heap::MarkSlice(size_t budget) {
+    Shader shader(*this);
+    for (size_t work = 0; work < budget && !gray_.empty(); ++work) {
+        auto obj = gray_.back();
+        gray_.pop_back();
+        obj->Trace(shader);
+    }
+    return gray_.empty();
+}
+
+bool Heap::SweepSlice(size_t budget) {
+    size_t work = 0;
+    auto is_live = [this](Object* obj) { return obj->mark_epoch_ == epoch_; };
+    while (sweep_pool_ < kSizeClassCount && work < budget) {
+        auto& pool = pools_[sweep_pool_];
+        if (!pool.IsSweeping()) {
+            ++sweep_pool_;
+            if (sweep_pool_ < kSizeClassCount) {
+                pools_[sweep_pool_].StartSweep();
+            }
+            continue;
+        }
+        work += pool.SweepStep(is_live, budget - work);
+    }
+    if (sweep_pool_ < kSizeClassCount) {
+        return false;
+    }
+    EndCycle();
+    return true;
+}
+
+void Heap::MarkAll() {
+    if (threads_ == 1) {
+        MarkSlice(SIZE_MAX);
+        return;
+    }
+    ParallelMarker(*this, threads_).Run(&gray_);
+}
+
+void Heap::SweepAll() {
+    if (threads_ == 1) {
+        SweepSlice(SIZE_MAX);
+        return;
+    }
+    struct Job {
+        SlabPool* pool;
+        SlabPool::Page* page;
+    };
+    RawVector<Job> jobs;
+    RawVector<SlabPool::Page*> pages;
+    for (auto& pool : pools_) {
+        pool.StartSweep();
+        pages.clear();
+        pool.ListPages(&pages);
+        for (auto page : pages) {
+            jobs.push_back({&pool, page});
+        }
+    }
+    const size_t kChunk = 16;
+    std::atomic<size_t> next = 0;
+    auto is_live = [this](Object* obj) { return obj->mark_epoch_ == epoch_; };
+    RunOnThreads(threads_, [&](size_t) {
+        for (size_t begin; (begin = next.fetch_add(kChunk)) < jobs.size();) {
+            auto end = std::min(begin + kChunk, jobs.size());
+            for (auto i = begin; i < end; ++i) {
+                jobs[i].pool->SweepPage(jobs[i].page, is_live);
+            }
+        }
+    });
+    for (auto& pool : pools_) {
+        pool.ReclaimSwept();
+    }
+    sweep_pool_ = kSizeClassCount;
+    EndCycle();
+}
+
+void Heap::EndCycle() {
+    phase_ = Phase::kIdle;
+    auto threshold = static_cast<size_t>(OldBytes() * (policy_.growth_factor - 1));
+    major_threshold_ = std::clamp(threshold, policy_.min_threshold, policy_.max_threshold);
+    ++stats_.major_collections;
+}
+
+void Heap::FinishCycle(Dispatcher* root) {
+    if (phase_ == Phase::kMarking) {
+        Shade(root);
+        {
+            PhaseTimer timer(&stats_.last_mark);
+            MarkAll();
+        }
+        StartSweep();
+        PhaseTimer timer(&stats_.last_sweep);
+        SweepAll();
+    }
+    if (phase_ == Phase::kSweeping) {
+        SweepSlice(SIZE_MAX);
+    }
+}
+
+void Heap::Collect(Dispatcher* root) {
+    PauseTimer timer(stats_);
+    collection_requested_ = false;
+    if (generational_) {
+        CollectNursery();
+    }
+    // A cycle in progress may keep objects which died after it began, so run a fresh one too.
+    FinishCycle(root);
+    StartCycle(root);
+    FinishCycle(root);
+}
+
+Dispatcher* Heap::TakeSpareFrame() {
+    if (spare_frames_.empty()) {
+        return nullptr;
+    }
+    auto frame = spare_frames_.back();
+    spare_frames_.pop_back();
+    return frame;
+}
+
+void Heap::AddSpareFrame(Dispatcher* frame) {
+    spare_frames_.push_back(frame);
+}
+
+void Heap::Clean(Dispatcher* root) {
+    // Only as many frames as the deepest recent recursion needed are worth keeping.
+    if (spare_frames_.size() > kMaxSpareFrames) {
+        spare_frames_.resize(kMaxSpareFrames);
+    }
+    if (collection_requested_) {
+        Collect(root);
+        return;
+    }
+    PauseTimer timer(stats_);
+    if (generational_) {
+        CollectNursery();
+    }
+    if (phase_ == Phase::kIdle && allocated_bytes_ >= major_threshold_) {
+        StartCycle(root);
+    }
+    if (slice_budget_ == 0) {
+        FinishCycle(root);
+        return;
+    }
+    if (phase_ == Phase::kMarking) {
+        // Everything reachable is now reachable from the root, so an empty gray stack means the
+        // marking is complete.
+        Shade(root);
+        if (!MarkSlice(slice_budget_)) {
+            return;
+        }
+        StartSweep();
+    }
+    if (phase_ == Phase::kSweeping) {
+        SweepSlice(slice_budget_);
+    }
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Object;
+class Dispatcher;
+class Symbol;
+class Heap;
+
+const size_t kPageSize = 1 << 14;
+const size_t kSlotGranularity = 16;
+const size_t kSizeClassCount = 16;
+const size_t kNurserySize = 1 << 20;
+const size_t kMinMajorThreshold = 1 << 20;
+const size_t kMaxMajorThreshold = 1 << 26;
+const size_t kMaxSpareFrames = 1 << 10;
+
+// Only even, non-null words point to objects; odd ones are immediate values which the collector
+// leaves alone.
+inline bool IsHeapObject(const Object* obj) {
+    return obj && !(reinterpret_cast<uintptr_t>(obj) & 1);
+}
+
+template <class T>
+constexpr size_t kSizeClass = (sizeof(T) + kSlotGranularity - 1) / kSlotGranularity - 1;
+
+// Collector bookkeeping, like the object pages themselves, does not go through operator new, so
+// checks which count its calls cannot see leaked objects; they have to look at GetLiveBytes.
+template <class T>
+struct RawAllocator {
+    using value_type = T;
+
+    RawAllocator() = default;
+    template <class U>
+    RawAllocator(const RawAllocator<U>&) {
+    }
+
+    T* allocate(size_t n) {
+        if (auto ptr = std::malloc(n * sizeof(T))) {
+            return static_cast<T*>(ptr);
+        }
+        throw std::bad_alloc();
+    }
+    void deallocate(T* ptr, size_t) {
+        std::free(ptr);
+    }
+
+    template <class U>
+    bool operator==(const RawAllocator<U>&) const {
+        return true;
+    }
+};
+
+template <class T>
+using RawVector = std::vector<T, RawAllocator<T>>;
+
+// Fixed-size slots carved out of kPageSize pages. Free slots are chained through their first
+// word, and a per-page bitmap tells the sweeper which slots hold constructed objects.
+class SlabPool {
+public:
+    struct Page;
+
+    SlabPool() = default;
+    SlabPool(const SlabPool&) = delete;
+    ~SlabPool();
+
+    void Init(size_t slot_size, Heap* owner);
+    void* Allocate();
+    void Deallocate(void* slot);
+    // Sweeping may be spread over several steps; allocation keeps working in between and only
+    // reuses slots of pages which have already been swept.
+    void StartSweep();
+    template <class IsLive>
+    size_t SweepStep(IsLive&& is_live, size_t budget);
+    // Sweeping from several threads: SweepPage touches nothing but the page, so distinct pages
+    // may be swept concurrently, and ReclaimSwept then takes all of them back at once.
+    void ListPages(RawVector<Page*>* pages) const;
+    template <class IsLive>
+    void SweepPage(Page* page, IsLive&& is_live) const;
+    void ReclaimSwept();
+    bool IsSweeping() const;
+    void ReleaseAll();
+    size_t LiveBytes() const;
+
+    // Every page starts with a pointer to the heap it belongs to.
+    static Heap* OwnerOf(const void* slot) {
+        auto page = reinterpret_cast<uintptr_t>(slot) & ~(kPageSize - 1);
+        return *reinterpret_cast<Heap* const*>(page);
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+    Page* AllocatePage();
+    Page* PageOf(void* slot) const;
+    std::byte* SlotAt(Page* page, size_t index) const;
+    size_t IndexOf(Page* page, void* slot) const;
+    void ReclaimNext();
+
+    Page* pages_ = nullptr;
+    Page** sweep_link_ = nullptr;
+    FreeSlot* free_list_ = nullptr;
+    Heap* owner_ = nullptr;
+    size_t slot_size_ = 0;
+    size_t slots_per_page_ = 0;
+    size_t live_slots_ = 0;
+};
+
+using PromoteFn = Object* (*)(Heap&, Object*);
+
+// Bump-pointer region for young objects. Every object is preceded by a header which records
+// how to move it into the old space and, once moved, where it went.
+class Nursery {
+public:
+    enum class State : uint8_t { kVacant, kLive, kForwarded };
+
+    struct Header {
+        union {
+            PromoteFn promote;
+            Object* forward;
+        };
+        uint32_t size;
+        State state;
+
+        void* Body() {
+            return this + 1;
+        }
+    };
+
+    Nursery() = default;
+    Nursery(const Nursery&) = delete;
+    ~Nursery();
+
+    void Init(size_t capacity);
+    Header* Allocate(size_t size) {
+        size = (sizeof(Header) + size + kSlotGranularity - 1) / kSlotGranularity * kSlotGranularity;
+        if (capacity_ - (top_ - begin_) < size) {
+            return nullptr;
+        }
+        auto header = reinterpret_cast<Header*>(top_);
+        top_ += size;
+        header->size = size;
+        header->state = State::kVacant;
+        return header;
+    }
+    bool Contains(const void* ptr) const {
+        return reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(begin_) < capacity_;
+    }
+    bool IsEmpty() const {
+        return top_ == begin_;
+    }
+    static Header* HeaderOf(Object* obj) {
+        return reinterpret_cast<Header*>(obj) - 1;
+    }
+    // Destroys whatever was not moved out and makes the whole region available again.
+    void Reset();
+
+private:
+    std::byte* begin_ = nullptr;
+    std::byte* top_ = nullptr;
+    size_t capacity_ = 0;
+};
+
+// A major cycle starts at a safepoint once the old space has taken `threshold` bytes since the
+// previous one. After each cycle the threshold becomes (growth_factor - 1) times the surviving
+// bytes, kept within [min_threshold, max_threshold].
+struct GcPolicy {
+    double growth_factor = 2.0;
+    size_t min_threshold = kMinMajorThreshold;
+    size_t max_threshold = kMaxMajorThreshold;
+};
+
+struct GcStats {
+    // Every object made since the heap was created.
+    size_t objects_made = 0;
+    size_t minor_collections = 0;
+    size_t major_collections = 0;
+    std::chrono::nanoseconds max_pause{0};
+    // Phases of the last stop-the-world major collection.
+    std::chrono::nanoseconds last_mark{0};
+    std::chrono::nanoseconds last_sweep{0};
+};
+
+class Heap {
+    class Evacuator;
+    class Shader;
+    class ParallelMarker;
+
+    enum class Phase { kIdle, kMarking, kSweeping };
+
+public:
+    Heap();
+    Heap(const Heap&) = delete;
+
+    // Young objects go to the nursery; when it is full (or generational mode is off) they are
+    // placed straight into the old space.
+    template <class T, class... Args>
+    requires std::is_base_of_v<Object, T> Object* Make(Args&&... args) {
+        if (phase_ != Phase::kIdle && constructing_ == 0) {
+            OnAllocation();
+        }
+        if (generational_) {
+            if (auto header = nursery_.Allocate(sizeof(T))) {
+                ++stats_.objects_made;
+                auto obj = new (header->Body()) T(std::forward<Args>(args)...);
+                header->promote = &Heap::Promote<T>;
+                header->state = Nursery::State::kLive;
+                return obj;
+            }
+        }
+        return MakeOld<T>(std::forward<Args>(args)...);
+    }
+
+    // Allocates directly in the old space, for objects known to be long-lived.
+    template <class T, class... Args>
+    requires std::is_base_of_v<Object, T> Object* MakeOld(Args&&... args) {
+        ++stats_.objects_made;
+        auto obj = Construct<T>(std::forward<Args>(args)...);
+        if (generational_) {
+            // It may be initialized with young references, which no barrier has seen.
+            Remember(obj);
+        }
+        return obj;
+    }
+
+    // Must be called after storing `value` into a field of `holder`. Only old holders have
+    // anything to report, and their page tells which heap to report it to.
+    static void WriteBarrier(Object* holder, Object* value);
+
+    // Returns the one symbol of this heap with the given name. Symbols go straight to the old
+    // space and never move; the table does not keep them alive.
+    Symbol* Intern(std::string_view name);
+
+    // The two boolean objects of this heap, which are never collected.
+    Object* GetBoolean(bool value) const {
+        return booleans_[value];
+    }
+
+    // Call frames which are no longer in use, kept in the old space for the next calls instead
+    // of being left to the collector.
+    Dispatcher* TakeSpareFrame();
+    void AddSpareFrame(Dispatcher* frame);
+
+    void SetGenerational(bool generational);
+    // A zero budget collects the old space in one stop-the-world pause. Otherwise marking and
+    // sweeping advance by at most `slice_budget` objects per slice, and a slice is taken every
+    // `slice_budget` allocations as well as at every Clean.
+    void SetIncremental(size_t slice_budget);
+    void SetPolicy(const GcPolicy& policy);
+    // Stop-the-world marking and sweeping are spread over this many threads.
+    void SetParallelism(size_t threads);
+    // Safepoint: evacuates the nursery and advances the major cycle when it is due.
+    void Clean(Dispatcher* root);
+    // Makes the next Clean perform a complete collection regardless of the policy.
+    void RequestCollection();
+    // Collects everything unreachable from `root` right away. Only valid at a safepoint.
+    void Collect(Dispatcher* root);
+    const GcStats& GetStats() const;
+    // Bytes taken by objects in the old space, garbage included until a sweep reclaims it. Frames
+    // kept for reuse are left out, as their number follows the deepest recent recursion.
+    size_t GetLiveBytes() const;
+
+private:
+    template <class T, class... Args>
+    Object* Construct(Args&&... args) {
+        static_assert(kSizeClass<T> < kSizeClassCount, "Object is too large for the slab");
+        static_assert(alignof(T) <= kSlotGranularity);
+        auto& pool = pools_[kSizeClass<T>];
+        void* slot = pool.Allocate();
+        allocated_bytes_ += (kSizeClass<T> + 1) * kSlotGranularity;
+        Object* obj;
+        // The slot is not a complete object yet, so no slice may sweep its page meanwhile.
+        ++constructing_;
+        try {
+            obj = new (slot) T(std::forward<Args>(args)...);
+        } catch (...) {
+            --constructing_;
+            pool.Deallocate(slot);
+            throw;
+        }
+        --constructing_;
+        AdmitOld(obj);
+        return obj;
+    }
+
+    template <class T>
+    static Object* Promote(Heap& heap, Object* obj) {
+        return heap.Construct<T>(std::move(*static_cast<T*>(obj)));
+    }
+
+    void Remember(Object* obj);
+    void AdmitOld(Object* obj);
+    void Shade(Object* obj);
+    bool TryMark(Object* obj);
+    void ShadeStored(Object* holder, Object* value);
+    void OnAllocation();
+    void CollectNursery();
+    void StartCycle(Dispatcher* root);
+    void StartSweep();
+    void PruneSymbols();
+    void FinishCycle(Dispatcher* root);
+    void EndCycle();
+    bool MarkSlice(size_t budget);
+    bool SweepSlice(size_t budget);
+    void MarkAll();
+    void SweepAll();
+    size_t OldBytes() const;
+
+    std::array<SlabPool, kSizeClassCount> pools_;
+    Nursery nursery_;
+    std::array<Object*, 2> booleans_;
+    std::unordered_map<std::string_view, Symbol*, std::hash<std::string_view>,
+                       std::equal_to<std::string_view>,
+                       RawAllocator<std::pair<const std::string_view, Symbol*>>>
+        symbols_;
+    uint32_t next_symbol_id_ = 0;
+    RawVector<Dispatcher*> spare_frames_;
+    RawVector<Object*> remembered_;
+    RawVector<Object*> gray_;
+    bool generational_ = false;
+    GcPolicy policy_;
+    size_t major_threshold_ = kMinMajorThreshold;
+    size_t allocated_bytes_ = 0;
+    bool collection_requested_ = false;
+
+    Phase phase_ = Phase::kIdle;
+    uint8_t epoch_ = 0;
+    size_t slice_budget_ = 0;
+    size_t threads_ = 1;
+    size_t allocations_until_slice_ = 0;
+    size_t sweep_pool_ = 0;
+    size_t constructing_ = 0;
+    GcStats stats_;
+};
+
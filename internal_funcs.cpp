@@ -1,21 +1,21 @@
-#include <numeric>
+#include <algorithm>
+#include <tuple>
+#include <utility>
 
+#include <compiler.h>
 #include <internal_funcs.h>
 
-const std::string kTrueStr = "#t";
-const std::string kFalseStr = "#f";
-
 const int64_t kAddInit = 0;
 const int64_t kMulInit = 1;
 const int64_t kMinInit = INT64_MAX;
 const int64_t kMaxInit = INT64_MIN;
 
-AST GetSymBool(bool val) {
-    return GetHeap().Make<Symbol>(val ? kTrueStr : kFalseStr);
+AST GetBool(Dispatcher& dispatcher, bool val) {
+    return dispatcher.GetHeap().GetBoolean(val);
 }
 
-bool ToBool(AST tree) {
-    return !(Is<Symbol>(tree) && As<Symbol>(tree)->GetName() == "#f");
+bool ToBool(Dispatcher& dispatcher, AST tree) {
+    return tree != dispatcher.GetHeap().GetBoolean(false);
 }
 
 template <class T>
@@ -44,18 +44,73 @@ bool HasAtLeast(const std::vector<T>& vec) {
     return vec.size() >= size;
 }
 
-bool AreAllNumbers(const std::vector<AST>& vec) {
-    return std::all_of(vec.begin(), vec.end(), [](AST elem) { return Is<Number>(elem); });
+// Conversion of a computed argument to the type a native builtin expects.
+template <class T>
+T ArgCast(AST arg) {
+    if constexpr (std::is_same_v<T, AST>) {
+        return arg;
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+        if (!Is<Number>(arg)) {
+            throw RuntimeError(kWrongArgs);
+        }
+        return As<Number>(arg)->GetValue();
+    } else {
+        auto obj = As<std::remove_pointer_t<T>>(arg);
+        if (!obj) {
+            throw RuntimeError(kWrongArgs);
+        }
+        return obj;
+    }
+}
+
+// The arguments of a builtin which takes exactly one of each of the types.
+template <class... Types, size_t... Indices>
+std::tuple<Types...> UnpackImpl([[maybe_unused]] ArgsSpan args, std::index_sequence<Indices...>) {
+    return {ArgCast<Types>(args[Indices])...};
+}
+
+template <class... Types>
+std::tuple<Types...> Unpack(ArgsSpan args) {
+    if (args.size() != sizeof...(Types)) {
+        throw RuntimeError(kWrongArgs);
+    }
+    return UnpackImpl<Types...>(args, std::index_sequence_for<Types...>{});
 }
 
+// The arguments of a builtin which takes at least `kMin` integers.
+template <size_t kMin = 0>
+class Integers {
+public:
+    explicit Integers(ArgsSpan args) : args_(args) {
+        if (args.size() < kMin) {
+            throw RuntimeError(kWrongArgs);
+        }
+        for (auto arg : args) {
+            if (!Is<Number>(arg)) {
+                throw RuntimeError(kWrongArgs);
+            }
+        }
+    }
+    size_t size() const {
+        return args_.size();
+    }
+    int64_t operator[](size_t i) const {
+        return As<Number>(args_[i])->GetValue();
+    }
+
+private:
+    ArgsSpan args_;
+};
+
 template <class Cmp>
-bool MonoCheck(const std::vector<AST>& vec) {
+AST Monotonic(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers values(args);
     Cmp comp;
     bool ok = true;
-    for (size_t i = 0; i + 1 < vec.size(); ++i) {
-        ok &= comp(As<Number>(vec[i])->GetValue(), As<Number>(vec[i + 1])->GetValue());
+    for (size_t i = 0; i + 1 < values.size(); ++i) {
+        ok &= comp(values[i], values[i + 1]);
     }
-    return ok;
+    return GetBool(dispatcher, ok);
 }
 
 std::vector<AST> ExtractRawData(Dispatcher& dispatcher, AST tree) {
@@ -80,158 +135,128 @@ std::vector<AST> ExtractProperList(Dispatcher& dispatcher, AST tree) {
     return res;
 }
 
-std::vector<int64_t> ArgsToInt(const std::vector<AST>& list) {
-    std::vector<int64_t> res;
-    res.reserve(list.size());
-    for (const auto& elem : list) {
-        if (!Is<Number>(elem)) {
-            throw RuntimeError(kWrongArgs);
-        }
-        res.push_back(As<Number>(elem)->GetValue());
-    }
-    return res;
-}
-
-std::vector<std::string> ArgsToStr(const std::vector<AST>& list) {
-    std::vector<std::string> res;
+std::vector<Symbol*> ArgsToSymbols(const std::vector<AST>& list) {
+    std::vector<Symbol*> res;
     res.reserve(list.size());
     for (const auto& elem : list) {
         if (!Is<Symbol>(elem)) {
             throw RuntimeError(kWrongArgs);
         }
-        res.push_back(As<Symbol>(elem)->GetName());
+        res.push_back(As<Symbol>(elem));
     }
     return res;
 }
 
-AST FuncIsNumber(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    return GetSymBool(CheckParams(args, {HasOnly<1, AST>, AreAllNumbers}));
+AST FuncIsNumber(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
+    return GetBool(dispatcher, Is<Number>(arg));
 }
 
-AST FuncIsPair(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    auto inner_list = ExtractRawData(dispatcher, cmp_args[0]);
-    return GetSymBool(!inner_list.empty() && ((inner_list.size() == 2 && inner_list.back()) ||
+AST FuncIsPair(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
+    auto inner_list = ExtractRawData(dispatcher, arg);
+    return GetBool(dispatcher,
+                      !inner_list.empty() && ((inner_list.size() == 2 && inner_list.back()) ||
                                               (inner_list.size() == 3 && !inner_list.back())));
 }
-AST FuncIsList(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
+AST FuncIsList(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
     try {
-        ExtractProperList(dispatcher, cmp_args[0]);
+        ExtractProperList(dispatcher, arg);
     } catch (std::runtime_error) {
-        return GetSymBool(false);
+        return GetBool(dispatcher, false);
     }
-    return GetSymBool(true);
+    return GetBool(dispatcher, true);
 }
-AST FuncIsNull(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    return GetSymBool(!cmp_args[0]);
+AST FuncIsNull(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
+    return GetBool(dispatcher, !arg);
 }
 
-AST FuncIsBoolean(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    bool ans = false;
-    if (Is<Symbol>(cmp_args[0])) {
-        auto str = As<Symbol>(cmp_args[0])->GetName();
-        if (str == kFalseStr || str == kTrueStr) {
-            ans = true;
-        }
-    }
-    return GetSymBool(ans);
+AST FuncIsBoolean(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
+    return GetBool(dispatcher, Is<Boolean>(arg));
 }
 
-AST FuncIsSymbol(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    return GetSymBool(Is<Symbol>(cmp_args[0]));
+AST FuncIsSymbol(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
+    return GetBool(dispatcher, Is<Symbol>(arg));
 }
 
-AST FuncEqual(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {AreAllNumbers});
-    return GetSymBool(CheckParams(cmp_args, {MonoCheck<std::equal_to<int64_t>>}));
+AST FuncEqual(Dispatcher& dispatcher, ArgsSpan args) {
+    return Monotonic<std::equal_to<int64_t>>(dispatcher, args);
 }
 
-AST FuncLess(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {AreAllNumbers});
-    return GetSymBool(CheckParams(cmp_args, {MonoCheck<std::less<int64_t>>}));
+AST FuncLess(Dispatcher& dispatcher, ArgsSpan args) {
+    return Monotonic<std::less<int64_t>>(dispatcher, args);
 }
 
-AST FuncGreater(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {AreAllNumbers});
-    return GetSymBool(CheckParams(cmp_args, {MonoCheck<std::greater<int64_t>>}));
+AST FuncGreater(Dispatcher& dispatcher, ArgsSpan args) {
+    return Monotonic<std::greater<int64_t>>(dispatcher, args);
 }
 
-AST FuncLessEqual(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {AreAllNumbers});
-    return GetSymBool(CheckParams(cmp_args, {MonoCheck<std::less_equal<int64_t>>}));
+AST FuncLessEqual(Dispatcher& dispatcher, ArgsSpan args) {
+    return Monotonic<std::less_equal<int64_t>>(dispatcher, args);
 }
 
-AST FuncGreaterEqual(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {AreAllNumbers});
-    return GetSymBool(CheckParams(cmp_args, {MonoCheck<std::greater_equal<int64_t>>}));
+AST FuncGreaterEqual(Dispatcher& dispatcher, ArgsSpan args) {
+    return Monotonic<std::greater_equal<int64_t>>(dispatcher, args);
 }
 
-AST FuncAdd(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    auto res = std::accumulate(int_list.begin(), int_list.end(), kAddInit, std::plus());
-    return GetHeap().Make<Number>(res);
-}
-AST FuncSub(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    CheckAndThrow<RuntimeError>(int_list, {HasAtLeast<2, int64_t>});
-    auto res = std::accumulate(std::next(int_list.begin()), int_list.end(), *int_list.begin(),
-                               std::minus());
-    return GetHeap().Make<Number>(res);
-}
-AST FuncMul(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    auto res = std::accumulate(int_list.begin(), int_list.end(), kMulInit, std::multiplies());
-    return GetHeap().Make<Number>(res);
+AST FuncAdd(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers values(args);
+    auto res = kAddInit;
+    for (size_t i = 0; i < values.size(); ++i) {
+        res += values[i];
+    }
+    return MakeNumber(dispatcher.GetHeap(), res);
 }
-AST FuncDiv(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    CheckAndThrow<RuntimeError>(int_list, {HasAtLeast<2, int64_t>});
-    auto res = std::accumulate(std::next(int_list.begin()), int_list.end(), *int_list.begin(),
-                               std::divides());
-    return GetHeap().Make<Number>(res);
+AST FuncSub(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers<2> values(args);
+    auto res = values[0];
+    for (size_t i = 1; i < values.size(); ++i) {
+        res -= values[i];
+    }
+    return MakeNumber(dispatcher.GetHeap(), res);
 }
-
-int64_t GetMin(int64_t lhs, const int64_t& rhs) {
-    return std::min(lhs, rhs);
+AST FuncMul(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers values(args);
+    auto res = kMulInit;
+    for (size_t i = 0; i < values.size(); ++i) {
+        res *= values[i];
+    }
+    return MakeNumber(dispatcher.GetHeap(), res);
 }
-
-AST FuncMin(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    CheckAndThrow<RuntimeError>(int_list, {HasAtLeast<1, int64_t>});
-    auto res = std::accumulate(int_list.begin(), int_list.end(), kMinInit, GetMin);
-    return GetHeap().Make<Number>(res);
+AST FuncDiv(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers<2> values(args);
+    auto res = values[0];
+    for (size_t i = 1; i < values.size(); ++i) {
+        res /= values[i];
+    }
+    return MakeNumber(dispatcher.GetHeap(), res);
 }
 
-int64_t GetMax(int64_t lhs, const int64_t& rhs) {
-    return std::max(lhs, rhs);
+AST FuncMin(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers<1> values(args);
+    auto res = kMinInit;
+    for (size_t i = 0; i < values.size(); ++i) {
+        res = std::min(res, values[i]);
+    }
+    return MakeNumber(dispatcher.GetHeap(), res);
 }
 
-AST FuncMax(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    CheckAndThrow<RuntimeError>(int_list, {HasAtLeast<1, int64_t>});
-    auto res = std::accumulate(int_list.begin(), int_list.end(), kMaxInit, GetMax);
-    return GetHeap().Make<Number>(res);
+AST FuncMax(Dispatcher& dispatcher, ArgsSpan args) {
+    Integers<1> values(args);
+    auto res = kMaxInit;
+    for (size_t i = 0; i < values.size(); ++i) {
+        res = std::max(res, values[i]);
+    }
+    return MakeNumber(dispatcher.GetHeap(), res);
 }
 
-AST FuncAbs(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto int_list = ArgsToInt(ComputeAll(dispatcher, args));
-    CheckAndThrow<RuntimeError>(int_list, {HasOnly<1, int64_t>});
-    return GetHeap().Make<Number>(std::abs(int_list[0]));
+AST FuncAbs(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [value] = Unpack<int64_t>(args);
+    return MakeNumber(dispatcher.GetHeap(), std::abs(value));
 }
 
 AST FuncQuote(Dispatcher& dispatcher, const ArgsVec& args) {
@@ -239,66 +264,58 @@ AST FuncQuote(Dispatcher& dispatcher, const ArgsVec& args) {
     return args[0];
 }
 
-AST FuncNot(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    return GetSymBool(!ToBool(cmp_args[0]));
+AST FuncNot(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [arg] = Unpack<AST>(args);
+    return GetBool(dispatcher, !ToBool(dispatcher, arg));
 }
 
-AST FuncAnd(Dispatcher& dispatcher, const ArgsVec& args) {
-    AST last_comp;
-    for (auto elem : args) {
-        last_comp = ComputeExpr(dispatcher, elem);
-        if (!ToBool(last_comp)) {
-            return last_comp;
-        }
-    }
+bool FuncAnd(Dispatcher& dispatcher, const ArgsVec& args, AST* result) {
     if (args.empty()) {
-        return GetSymBool(true);
+        *result = GetBool(dispatcher, true);
+        return false;
     }
-    return last_comp;
-}
-
-AST FuncOr(Dispatcher& dispatcher, const ArgsVec& args) {
-    AST last_comp;
-    for (auto elem : args) {
-        last_comp = ComputeExpr(dispatcher, elem);
-        if (ToBool(last_comp)) {
-            return last_comp;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        *result = ComputeExpr(dispatcher, args[i]);
+        if (!ToBool(dispatcher, *result)) {
+            return false;
         }
     }
+    *result = args.back();
+    return true;
+}
+
+bool FuncOr(Dispatcher& dispatcher, const ArgsVec& args, AST* result) {
     if (args.empty()) {
-        return GetSymBool(false);
+        *result = GetBool(dispatcher, false);
+        return false;
     }
-    return last_comp;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        *result = ComputeExpr(dispatcher, args[i]);
+        if (ToBool(dispatcher, *result)) {
+            return false;
+        }
+    }
+    *result = args.back();
+    return true;
 }
 
-AST FuncCons(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<2, AST>});
-    auto cur_cell = As<Cell>(GetHeap().Make<Cell>());
-    cur_cell->SetFirst(cmp_args[0]);
-    cur_cell->SetSecond(cmp_args[1]);
+AST FuncCons(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [first, second] = Unpack<AST, AST>(args);
+    auto cur_cell = As<Cell>(dispatcher.GetHeap().Make<Cell>());
+    cur_cell->SetFirst(first);
+    cur_cell->SetSecond(second);
     return cur_cell;
 }
-AST FuncCar(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    if (!Is<Cell>(cmp_args[0])) {
-        throw RuntimeError(kWrongArgs);
-    }
-    return As<Cell>(cmp_args[0])->GetFirst();
+AST FuncCar(Dispatcher&, ArgsSpan args) {
+    auto [cell] = Unpack<Cell*>(args);
+    return cell->GetFirst();
 }
-AST FuncCdr(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<1, AST>});
-    if (!Is<Cell>(cmp_args[0])) {
-        throw RuntimeError(kWrongArgs);
-    }
-    return As<Cell>(cmp_args[0])->GetSecond();
+AST FuncCdr(Dispatcher&, ArgsSpan args) {
+    auto [cell] = Unpack<Cell*>(args);
+    return cell->GetSecond();
 }
 
-AST CreateList(const std::vector<AST>& list) {
+AST CreateList(Heap& heap, ArgsSpan list) {
     if (list.empty()) {
         return nullptr;
     }
@@ -306,9 +323,9 @@ AST CreateList(const std::vector<AST>& list) {
     Cell* cur_cell = nullptr;
     for (auto elem : list) {
         if (!root_cell) {
-            cur_cell = root_cell = As<Cell>(GetHeap().Make<Cell>());
+            cur_cell = root_cell = As<Cell>(heap.Make<Cell>());
         } else {
-            cur_cell->SetSecond(GetHeap().Make<Cell>());
+            cur_cell->SetSecond(heap.Make<Cell>());
             cur_cell = As<Cell>(cur_cell->GetSecond());
         }
         cur_cell->SetFirst(elem);
@@ -316,89 +333,95 @@ AST CreateList(const std::vector<AST>& list) {
     return root_cell;
 }
 
-AST FuncList(Dispatcher& dispatcher, const ArgsVec& args) {
-    return CreateList(ComputeAll(dispatcher, args));
+AST FuncList(Dispatcher& dispatcher, ArgsSpan args) {
+    return CreateList(dispatcher.GetHeap(), args);
 }
-AST FuncListRef(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<2, AST>});
-    auto inner_list = ExtractProperList(dispatcher, cmp_args[0]);
-    if (!Is<Number>(cmp_args[1])) {
-        throw RuntimeError(kWrongArgs);
-    }
-    auto num = As<Number>(cmp_args[1])->GetValue();
+AST FuncListRef(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [list, num] = Unpack<AST, int64_t>(args);
+    auto inner_list = ExtractProperList(dispatcher, list);
     if (num < 0 || static_cast<size_t>(num) >= inner_list.size()) {
         throw RuntimeError(kWrongArgs);
     }
     return inner_list[num];
 }
-AST FuncListTail(Dispatcher& dispatcher, const ArgsVec& args) {
-    auto cmp_args = ComputeAll(dispatcher, args);
-    CheckAndThrow<RuntimeError>(cmp_args, {HasOnly<2, AST>});
-    auto inner_list = ExtractProperList(dispatcher, cmp_args[0]);
-    if (!Is<Number>(cmp_args[1])) {
-        throw RuntimeError(kWrongArgs);
-    }
-    auto num = As<Number>(cmp_args[1])->GetValue();
+AST FuncListTail(Dispatcher& dispatcher, ArgsSpan args) {
+    auto [list, num] = Unpack<AST, int64_t>(args);
+    auto inner_list = ExtractProperList(dispatcher, list);
     if (num < 0 || static_cast<size_t>(num) > inner_list.size()) {
         throw RuntimeError(kWrongArgs);
     }
-    return CreateList({inner_list.begin() + num, inner_list.end()});
+    return CreateList(dispatcher.GetHeap(), ArgsSpan(inner_list).subspan(num));
 }
 
-AST FuncIf(Dispatcher& dispatcher, const ArgsVec& args) {
+bool FuncIf(Dispatcher& dispatcher, const ArgsVec& args, AST* result) {
     if (args.size() != 2 && args.size() != 3) {
         throw SyntaxError(kWrongArgs);
     }
-    if (ToBool(ComputeExpr(dispatcher, args[0]))) {
-        return ComputeExpr(dispatcher, args[1]);
-    } else {
-        return (args.size() == 2 ? nullptr : ComputeExpr(dispatcher, args[2]));
+    if (ToBool(dispatcher, ComputeExpr(dispatcher, args[0]))) {
+        *result = args[1];
+        return true;
     }
+    *result = (args.size() == 2 ? nullptr : args[2]);
+    return true;
 }
 AST FuncDefine(Dispatcher& dispatcher, const ArgsVec& args) {
     CheckAndThrow<SyntaxError>(args, {HasAtLeast<2, AST>});
-    if (Is<Symbol>(args[0])) {
+    if (Is<Symbol>(args[0]) || Is<LocalRef>(args[0])) {
         CheckAndThrow<SyntaxError>(args, {HasOnly<2, AST>});
-        dispatcher.Define(As<Symbol>(args[0])->GetName(), ComputeExpr(dispatcher, args[1]));
+        auto value = ComputeExpr(dispatcher, args[1]);
+        if (auto ref = As<LocalRef>(args[0])) {
+            ref->Define(dispatcher, value);
+        } else {
+            dispatcher.Define(As<Symbol>(args[0]), value);
+        }
     } else {
-        auto names = ArgsToStr(ExtractProperListWithoutComputing(args[0]));
-        auto func = GetHeap().Make<CustomFunction>(
-            dispatcher, std::vector<std::string>(std::next(names.begin()), names.end()),
-            ArgsVec(std::next(args.begin()), args.end()));
+        auto names = ArgsToSymbols(ExtractProperListWithoutComputing(args[0]));
+        auto func = dispatcher.GetHeap().Make<CustomFunction>(
+            dispatcher,
+            CompileLambda(dispatcher, std::vector<Symbol*>(std::next(names.begin()), names.end()),
+                          ArgsVec(std::next(args.begin()), args.end())));
         dispatcher.Define(names[0], func);
     }
     return nullptr;
 }
 AST FuncSet(Dispatcher& dispatcher, const ArgsVec& args) {
     CheckAndThrow<SyntaxError>(args, {HasOnly<2, AST>});
+    if (auto ref = As<LocalRef>(args[0])) {
+        ref->Set(dispatcher, ComputeExpr(dispatcher, args[1]));
+        return nullptr;
+    }
     if (!Is<Symbol>(args[0])) {
         throw RuntimeError(kWrongArgs);
     }
-    dispatcher.Set(As<Symbol>(args[0])->GetName(), ComputeExpr(dispatcher, args[1]));
+    dispatcher.Set(As<Symbol>(args[0]), ComputeExpr(dispatcher, args[1]));
     return nullptr;
 }
-AST FuncSetCar(Dispatcher& dispatcher, const ArgsVec& args) {
-    CheckAndThrow<SyntaxError>(args, {HasOnly<2, AST>});
-    auto cmp_args = ComputeAll(dispatcher, args);
-    if (!Is<Cell>(cmp_args[0])) {
-        throw RuntimeError(kWrongArgs);
+AST FuncSetCar(Dispatcher&, ArgsSpan args) {
+    if (args.size() != 2) {
+        throw SyntaxError(kWrongArgs);
     }
-    As<Cell>(cmp_args[0])->SetFirst(cmp_args[1]);
+    auto [cell, value] = Unpack<Cell*, AST>(args);
+    cell->SetFirst(value);
     return nullptr;
 }
-AST FuncSetCdr(Dispatcher& dispatcher, const ArgsVec& args) {
-    CheckAndThrow<SyntaxError>(args, {HasOnly<2, AST>});
-    auto cmp_args = ComputeAll(dispatcher, args);
-    if (!Is<Cell>(cmp_args[0])) {
-        throw RuntimeError(kWrongArgs);
+AST FuncSetCdr(Dispatcher&, ArgsSpan args) {
+    if (args.size() != 2) {
+        throw SyntaxError(kWrongArgs);
     }
-    As<Cell>(cmp_args[0])->SetSecond(cmp_args[1]);
+    auto [cell, value] = Unpack<Cell*, AST>(args);
+    cell->SetSecond(value);
     return nullptr;
 }
 AST FuncLambda(Dispatcher& dispatcher, const ArgsVec& args) {
     CheckAndThrow<SyntaxError>(args, {HasAtLeast<2, AST>});
-    auto func_args = ArgsToStr(ExtractProperListWithoutComputing(args[0]));
-    return GetHeap().Make<CustomFunction>(dispatcher, func_args,
-                                          ArgsVec(std::next(args.begin()), args.end()));
-}
\ No newline at end of file
+    auto func_args = ArgsToSymbols(ExtractProperListWithoutComputing(args[0]));
+    return dispatcher.GetHeap().Make<CustomFunction>(
+        dispatcher, CompileLambda(dispatcher, std::move(func_args),
+                                  ArgsVec(std::next(args.begin()), args.end())));
+}
+AST FuncGc(Dispatcher& dispatcher, ArgsSpan args) {
+    Unpack<>(args);
+    // Objects may only be freed between expressions, so the collection waits for the end of Run.
+    dispatcher.GetHeap().RequestCollection();
+    return nullptr;
+}
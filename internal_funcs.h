@@ -1,46 +1,48 @@
 #pragma once
 #include <object.h>
 
-AST FuncIsNumber(Dispatcher&, const ArgsVec&);
-AST FuncIsPair(Dispatcher&, const ArgsVec&);
-AST FuncIsList(Dispatcher&, const ArgsVec&);
-AST FuncIsNull(Dispatcher&, const ArgsVec&);
-AST FuncIsBoolean(Dispatcher&, const ArgsVec&);
-AST FuncIsSymbol(Dispatcher&, const ArgsVec&);
+AST FuncIsNumber(Dispatcher&, ArgsSpan);
+AST FuncIsPair(Dispatcher&, ArgsSpan);
+AST FuncIsList(Dispatcher&, ArgsSpan);
+AST FuncIsNull(Dispatcher&, ArgsSpan);
+AST FuncIsBoolean(Dispatcher&, ArgsSpan);
+AST FuncIsSymbol(Dispatcher&, ArgsSpan);
 
-AST FuncEqual(Dispatcher&, const ArgsVec&);
-AST FuncLess(Dispatcher&, const ArgsVec&);
-AST FuncGreater(Dispatcher&, const ArgsVec&);
-AST FuncLessEqual(Dispatcher&, const ArgsVec&);
-AST FuncGreaterEqual(Dispatcher&, const ArgsVec&);
+AST FuncEqual(Dispatcher&, ArgsSpan);
+AST FuncLess(Dispatcher&, ArgsSpan);
+AST FuncGreater(Dispatcher&, ArgsSpan);
+AST FuncLessEqual(Dispatcher&, ArgsSpan);
+AST FuncGreaterEqual(Dispatcher&, ArgsSpan);
 
-AST FuncAdd(Dispatcher&, const ArgsVec&);
-AST FuncSub(Dispatcher&, const ArgsVec&);
-AST FuncMul(Dispatcher&, const ArgsVec&);
-AST FuncDiv(Dispatcher&, const ArgsVec&);
+AST FuncAdd(Dispatcher&, ArgsSpan);
+AST FuncSub(Dispatcher&, ArgsSpan);
+AST FuncMul(Dispatcher&, ArgsSpan);
+AST FuncDiv(Dispatcher&, ArgsSpan);
 
-AST FuncMin(Dispatcher&, const ArgsVec&);
-AST FuncMax(Dispatcher&, const ArgsVec&);
+AST FuncMin(Dispatcher&, ArgsSpan);
+AST FuncMax(Dispatcher&, ArgsSpan);
 
-AST FuncAbs(Dispatcher&, const ArgsVec&);
+AST FuncAbs(Dispatcher&, ArgsSpan);
 
 AST FuncQuote(Dispatcher&, const ArgsVec&);
 
-AST FuncNot(Dispatcher&, const ArgsVec&);
-AST FuncAnd(Dispatcher&, const ArgsVec&);
-AST FuncOr(Dispatcher&, const ArgsVec&);
+AST FuncNot(Dispatcher&, ArgsSpan);
+bool FuncAnd(Dispatcher&, const ArgsVec&, AST*);
+bool FuncOr(Dispatcher&, const ArgsVec&, AST*);
 
-AST FuncCons(Dispatcher&, const ArgsVec&);
-AST FuncCar(Dispatcher&, const ArgsVec&);
-AST FuncCdr(Dispatcher&, const ArgsVec&);
+AST FuncCons(Dispatcher&, ArgsSpan);
+AST FuncCar(Dispatcher&, ArgsSpan);
+AST FuncCdr(Dispatcher&, ArgsSpan);
 
-AST FuncList(Dispatcher&, const ArgsVec&);
-AST FuncListRef(Dispatcher&, const ArgsVec&);
-AST FuncListTail(Dispatcher&, const ArgsVec&);
+AST FuncList(Dispatcher&, ArgsSpan);
+AST FuncListRef(Dispatcher&, ArgsSpan);
+AST FuncListTail(Dispatcher&, ArgsSpan);
 
-AST FuncIf(Dispatcher&, const ArgsVec&);
+bool FuncIf(Dispatcher&, const ArgsVec&, AST*);
 AST FuncDefine(Dispatcher&, const ArgsVec&);
 AST FuncSet(Dispatcher&, const ArgsVec&);
-AST FuncSetCar(Dispatcher&, const ArgsVec&);
-AST FuncSetCdr(Dispatcher&, const ArgsVec&);
+AST FuncSetCar(Dispatcher&, ArgsSpan);
+AST FuncSetCdr(Dispatcher&, ArgsSpan);
 AST FuncLambda(Dispatcher&, const ArgsVec&);
+
+AST FuncGc(Dispatcher&, ArgsSpan);
@@ -0,0 +1,459 @@
+#include <jit.h>
+
+#include <utility>
+
+#include <bytecode.h>
+
+#ifdef SCHEME_JIT
+#include <cstring>
+#include <initializer_list>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MachineCode::MachineCode(void* pages, size_t size) : pages_(pages), size_(size) {
+}
+
+MachineCode::MachineCode(MachineCode&& other)
+    : pages_(std::exchange(other.pages_, nullptr)), size_(std::exchange(other.size_, 0)) {
+}
+
+MachineCode& MachineCode::operator=(MachineCode&& other) {
+    std::swap(pages_, other.pages_);
+    std::swap(size_, other.size_);
+    return *this;
+}
+
+MachineCode::~MachineCode() {
+#ifdef SCHEME_JIT
+    if (pages_) {
+        munmap(pages_, size_);
+    }
+#endif
+}
+
+#ifdef SCHEME_JIT
+
+namespace {
+
+enum Reg : uint8_t {
+    kRax = 0,
+    kRcx = 1,
+    kRdx = 2,
+    kRbx = 3,
+    kRsp = 4,
+    kRbp = 5,
+    kRsi = 6,
+    kRdi = 7,
+    kR8 = 8,
+    kR12 = 12,
+    kR13 = 13,
+    kR14 = 14,
+    kR15 = 15,
+};
+
+// Condition codes of jcc and cmovcc.
+enum Condition : uint8_t {
+    kOverflow = 0x0,
+    kEqual = 0x4,
+    kNotEqual = 0x5,
+    kLess = 0xC,
+    kGreaterEqual = 0xD,
+    kLessEqual = 0xE,
+    kGreater = 0xF,
+};
+
+// Encodes the few instructions the templates need. Arithmetic is on 64-bit registers.
+class Assembler {
+public:
+    const RawVector<uint8_t>& GetBytes() const {
+        return bytes_;
+    }
+    size_t Here() const {
+        return bytes_.size();
+    }
+
+    void Push(Reg reg) {
+        if (reg >= kR8) {
+            Byte(0x41);
+        }
+        Byte(0x50 + (reg & 7));
+    }
+    void Pop(Reg reg) {
+        if (reg >= kR8) {
+            Byte(0x41);
+        }
+        Byte(0x58 + (reg & 7));
+    }
+    void Ret() {
+        Byte(0xC3);
+    }
+
+    // mov dst, [base + disp]
+    void Load(Reg dst, Reg base, int32_t disp) {
+        Rex(dst, base);
+        Byte(0x8B);
+        Memory(dst, base, disp);
+    }
+    // mov [base + disp], src
+    void Store(Reg base, int32_t disp, Reg src) {
+        Rex(src, base);
+        Byte(0x89);
+        Memory(src, base, disp);
+    }
+    // mov eax, eax, clearing the upper half of rax
+    void ZeroExtendEax() {
+        Bytes({0x89, 0xC0});
+    }
+    // mov rax, [rbp + rax * 8]
+    void LoadIndexedByRax() {
+        Bytes({0x48, 0x8B, 0x44, 0xC5, 0x00});
+    }
+
+    void Mov(Reg dst, Reg src) {
+        RegisterOp(0x89, dst, src);
+    }
+    void Add(Reg dst, Reg src) {
+        RegisterOp(0x01, dst, src);
+    }
+    void Sub(Reg dst, Reg src) {
+        RegisterOp(0x29, dst, src);
+    }
+    void And(Reg dst, Reg src) {
+        RegisterOp(0x21, dst, src);
+    }
+    void Cmp(Reg lhs, Reg rhs) {
+        RegisterOp(0x39, lhs, rhs);
+    }
+    void Imul(Reg dst, Reg src) {
+        Rex(dst, src);
+        Bytes({0x0F, 0xAF});
+        Byte(0xC0 | (dst & 7) << 3 | (src & 7));
+    }
+    void Cmov(Condition cc, Reg dst, Reg src) {
+        Rex(dst, src);
+        Bytes({0x0F, static_cast<uint8_t>(0x40 + cc)});
+        Byte(0xC0 | (dst & 7) << 3 | (src & 7));
+    }
+    void AddImm(Reg reg, int8_t imm) {
+        ImmediateOp(0, reg, imm);
+    }
+    void SubImm(Reg reg, int8_t imm) {
+        ImmediateOp(5, reg, imm);
+    }
+    void OrImm(Reg reg, int8_t imm) {
+        ImmediateOp(1, reg, imm);
+    }
+    // sar reg, 1
+    void Sar1(Reg reg) {
+        Rex(kRax, reg);
+        Bytes({0xD1, static_cast<uint8_t>(0xF8 | (reg & 7))});
+    }
+    // test reg, imm
+    void Test(Reg reg, int32_t imm) {
+        Rex(kRax, reg);
+        Bytes({0xF7, static_cast<uint8_t>(0xC0 | (reg & 7))});
+        Imm32(imm);
+    }
+    // cmp eax, imm
+    void CmpEax(uint32_t imm) {
+        Byte(0x3D);
+        Imm32(imm);
+    }
+    // mov reg32, imm
+    void MovImm32(Reg reg, uint32_t imm) {
+        if (reg >= kR8) {
+            Byte(0x41);
+        }
+        Byte(0xB8 + (reg & 7));
+        Imm32(imm);
+    }
+    void MovImm64(Reg reg, uint64_t imm) {
+        Rex(kRax, reg);
+        Byte(0xB8 + (reg & 7));
+        for (int i = 0; i < 8; ++i) {
+            Byte(imm >> (8 * i));
+        }
+    }
+    void Call(Reg reg) {
+        Byte(0xFF);
+        Byte(0xD0 | (reg & 7));
+    }
+    void Jump(Reg reg) {
+        Byte(0xFF);
+        Byte(0xE0 | (reg & 7));
+    }
+
+    // Jumps whose displacement is patched once the target is known. Both return the position
+    // of the displacement.
+    size_t Jump() {
+        Byte(0xE9);
+        return Displacement();
+    }
+    size_t JumpIf(Condition cc) {
+        Bytes({0x0F, static_cast<uint8_t>(0x80 + cc)});
+        return Displacement();
+    }
+    void Patch(size_t at, size_t target) {
+        auto rel = static_cast<int32_t>(target - (at + 4));
+        std::memcpy(&bytes_[at], &rel, sizeof(rel));
+    }
+    // Returns the position of the immediate, to be patched once the value is known.
+    size_t MovImm64(Reg reg) {
+        MovImm64(reg, 0);
+        return Here() - 8;
+    }
+    void PatchImm64(size_t at, uint64_t imm) {
+        std::memcpy(&bytes_[at], &imm, sizeof(imm));
+    }
+
+private:
+    void Byte(uint8_t byte) {
+        bytes_.push_back(byte);
+    }
+    void Bytes(std::initializer_list<uint8_t> bytes) {
+        bytes_.insert(bytes_.end(), bytes);
+    }
+    void Imm32(uint32_t imm) {
+        for (int i = 0; i < 4; ++i) {
+            Byte(imm >> (8 * i));
+        }
+    }
+    size_t Displacement() {
+        Imm32(0);
+        return Here() - 4;
+    }
+    // REX.W, extended by the high bits of the ModRM fields.
+    void Rex(Reg reg, Reg rm) {
+        Byte(0x48 | (reg >> 3) << 2 | (rm >> 3));
+    }
+    void Memory(Reg reg, Reg base, int32_t disp) {
+        Byte(0x80 | (reg & 7) << 3 | (base & 7));
+        if ((base & 7) == 4) {
+            Byte(0x24);
+        }
+        Imm32(disp);
+    }
+    void RegisterOp(uint8_t opcode, Reg rm, Reg reg) {
+        Rex(reg, rm);
+        Byte(opcode);
+        Byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+    void ImmediateOp(uint8_t ext, Reg reg, int8_t imm) {
+        Rex(kRax, reg);
+        Bytes({0x83, static_cast<uint8_t>(0xC0 | ext << 3 | (reg & 7))});
+        Byte(imm);
+    }
+
+    RawVector<uint8_t> bytes_;
+};
+
+// Registers which keep their meaning through the whole code. They are callee-saved, so calls of
+// the StepFunc leave them alone.
+const Reg kRegs = kRbx;
+const Reg kConstants = kR12;
+const Reg kState = kR13;
+const Reg kFalse = kR14;
+const Reg kTrue = kR15;
+const Reg kTargets = kRbp;
+
+int32_t Slot(uint32_t index) {
+    return static_cast<int32_t>(index * sizeof(AST));
+}
+
+class Generator {
+public:
+    Generator(const Bytecode& code, const StepFunc* steps)
+        : code_(code), steps_(steps), offsets_(code.instructions.size()) {
+    }
+
+    void Generate() {
+        for (auto reg : {kRbx, kRbp, kR12, kR13, kR14, kR15}) {
+            asm_.Push(reg);
+        }
+        // Keeps the stack aligned to 16 bytes at calls.
+        asm_.SubImm(kRsp, 8);
+        asm_.Mov(kState, kRdi);
+        asm_.Mov(kRegs, kRsi);
+        asm_.Mov(kConstants, kRdx);
+        asm_.Mov(kFalse, kRcx);
+        asm_.Mov(kTrue, kR8);
+        targets_ = asm_.MovImm64(kTargets);
+
+        for (uint32_t pc = 0; pc < code_.instructions.size(); ++pc) {
+            offsets_[pc] = asm_.Here();
+            Emit(pc, code_.instructions[pc]);
+        }
+
+        // The StepFunc has left the index of the next instruction in eax; the ABI leaves the
+        // upper half of rax undefined.
+        auto dispatch = asm_.Here();
+        asm_.CmpEax(kFinished);
+        exits_.push_back(asm_.JumpIf(kEqual));
+        asm_.ZeroExtendEax();
+        asm_.LoadIndexedByRax();
+        asm_.Jump(kRax);
+
+        for (auto [at, pc] : deopts_) {
+            asm_.Patch(at, asm_.Here());
+            asm_.MovImm32(kRax, pc);
+            exits_.push_back(asm_.Jump());
+        }
+
+        auto epilogue = asm_.Here();
+        asm_.AddImm(kRsp, 8);
+        for (auto reg : {kR15, kR14, kR13, kR12, kRbp, kRbx}) {
+            asm_.Pop(reg);
+        }
+        asm_.Ret();
+
+        for (auto [at, pc] : jumps_) {
+            asm_.Patch(at, offsets_[pc]);
+        }
+        for (auto at : dispatches_) {
+            asm_.Patch(at, dispatch);
+        }
+        for (auto at : exits_) {
+            asm_.Patch(at, epilogue);
+        }
+    }
+
+    // Places the code at `base`, followed by the address of the code of every instruction, for
+    // the jumps made by the StepFunc. Returns the size of both.
+    size_t Place(uint8_t* base) {
+        auto code_size = (asm_.GetBytes().size() + 7) / 8 * 8;
+        auto targets = reinterpret_cast<uintptr_t*>(base + code_size);
+        if (base) {
+            asm_.PatchImm64(targets_, reinterpret_cast<uint64_t>(targets));
+            std::memcpy(base, asm_.GetBytes().data(), asm_.GetBytes().size());
+            for (size_t pc = 0; pc < offsets_.size(); ++pc) {
+                targets[pc] = reinterpret_cast<uintptr_t>(base + offsets_[pc]);
+            }
+        }
+        return code_size + offsets_.size() * sizeof(uintptr_t);
+    }
+
+private:
+    void Emit(uint32_t pc, const Instruction& instr) {
+        switch (instr.op) {
+            case Opcode::kLoadConst:
+                asm_.Load(kRax, kConstants, Slot(instr.b));
+                asm_.Store(kRegs, Slot(instr.a), kRax);
+                break;
+            case Opcode::kJump:
+                jumps_.emplace_back(asm_.Jump(), instr.b);
+                break;
+            case Opcode::kJumpIfFalse:
+            case Opcode::kJumpIfTrue:
+                asm_.Load(kRax, kRegs, Slot(instr.a));
+                asm_.Cmp(kRax, kFalse);
+                jumps_.emplace_back(
+                    asm_.JumpIf(instr.op == Opcode::kJumpIfFalse ? kEqual : kNotEqual), instr.b);
+                break;
+            case Opcode::kAdd:
+                LoadFixnums(pc, instr);
+                asm_.SubImm(kRax, 1);
+                asm_.Add(kRax, kRdx);
+                deopts_.emplace_back(asm_.JumpIf(kOverflow), pc);
+                asm_.Store(kRegs, Slot(instr.a), kRax);
+                break;
+            case Opcode::kSub:
+                LoadFixnums(pc, instr);
+                asm_.Sub(kRax, kRdx);
+                deopts_.emplace_back(asm_.JumpIf(kOverflow), pc);
+                asm_.OrImm(kRax, 1);
+                asm_.Store(kRegs, Slot(instr.a), kRax);
+                break;
+            case Opcode::kMul:
+                LoadFixnums(pc, instr);
+                asm_.Sar1(kRax);
+                asm_.SubImm(kRdx, 1);
+                asm_.Imul(kRax, kRdx);
+                deopts_.emplace_back(asm_.JumpIf(kOverflow), pc);
+                asm_.OrImm(kRax, 1);
+                asm_.Store(kRegs, Slot(instr.a), kRax);
+                break;
+            case Opcode::kEqual:
+                Compare(pc, instr, kEqual);
+                break;
+            case Opcode::kLess:
+                Compare(pc, instr, kLess);
+                break;
+            case Opcode::kGreater:
+                Compare(pc, instr, kGreater);
+                break;
+            case Opcode::kLessEqual:
+                Compare(pc, instr, kLessEqual);
+                break;
+            case Opcode::kGreaterEqual:
+                Compare(pc, instr, kGreaterEqual);
+                break;
+            default:
+                asm_.Mov(kRdi, kState);
+                asm_.MovImm32(kRsi, pc);
+                asm_.MovImm64(kRax,
+                              reinterpret_cast<uint64_t>(steps_[static_cast<size_t>(instr.op)]));
+                asm_.Call(kRax);
+                asm_.CmpEax(pc + 1);
+                dispatches_.push_back(asm_.JumpIf(kNotEqual));
+        }
+    }
+
+    // Loads the operands into rax and rdx, leaving to the interpreter unless both are fixnums.
+    void LoadFixnums(uint32_t pc, const Instruction& instr) {
+        asm_.Load(kRax, kRegs, Slot(instr.b));
+        asm_.Load(kRdx, kRegs, Slot(instr.c));
+        asm_.Mov(kRcx, kRax);
+        asm_.And(kRcx, kRdx);
+        asm_.Test(kRcx, 1);
+        deopts_.emplace_back(asm_.JumpIf(kEqual), pc);
+    }
+
+    // Tagged fixnums compare in the same order as their values.
+    void Compare(uint32_t pc, const Instruction& instr, Condition cc) {
+        LoadFixnums(pc, instr);
+        asm_.Cmp(kRax, kRdx);
+        asm_.Mov(kRax, kFalse);
+        asm_.Cmov(cc, kRax, kTrue);
+        asm_.Store(kRegs, Slot(instr.a), kRax);
+    }
+
+    const Bytecode& code_;
+    const StepFunc* steps_;
+    Assembler asm_;
+    size_t targets_ = 0;
+    RawVector<size_t> offsets_;
+    // Displacements to patch, with the instructions they lead to.
+    RawVector<std::pair<size_t, uint32_t>> jumps_;
+    RawVector<std::pair<size_t, uint32_t>> deopts_;
+    RawVector<size_t> dispatches_;
+    RawVector<size_t> exits_;
+};
+
+}  // namespace
+
+MachineCode CompileMachineCode(const Bytecode& code, const StepFunc* steps) {
+    Generator generator(code, steps);
+    generator.Generate();
+    auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto size = (generator.Place(nullptr) + page - 1) / page * page;
+    auto pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) {
+        return {};
+    }
+    generator.Place(static_cast<uint8_t*>(pages));
+    if (mprotect(pages, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(pages, size);
+        return {};
+    }
+    return {pages, size};
+}
+
+#else
+
+MachineCode CompileMachineCode(const Bytecode&, const StepFunc*) {
+    return {};
+}
+
+#endif
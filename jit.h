@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <object.h>
+
+struct Bytecode;
+
+// Returned instead of the index of an instruction once the call is over.
+const uint32_t kFinished = UINT32_MAX;
+
+// Runs instruction `pc` of the call `state` on the interpreter, and returns the index of the
+// next one. It must not throw, since the exception would have to unwind machine code.
+typedef uint32_t (*StepFunc)(void* state, uint32_t pc);
+
+// x86-64 code for the body of a lambda, in pages of its own. Arithmetic and comparisons of
+// fixnums, constants and jumps are inlined; the other instructions are left to the StepFunc of
+// their opcode. Like the rest of the VM, it allocates nothing through operator new.
+class MachineCode {
+public:
+    typedef uint32_t (*Entry)(void* state, AST* regs, const AST* constants, AST false_value,
+                              AST true_value);
+
+    MachineCode() = default;
+    MachineCode(void* pages, size_t size);
+    MachineCode(MachineCode&& other);
+    MachineCode& operator=(MachineCode&& other);
+    ~MachineCode();
+
+    explicit operator bool() const {
+        return pages_;
+    }
+
+    // Runs the code from the start. Returns kFinished, or the instruction at which the
+    // interpreter has to take over, as a guard on the types of the operands has failed.
+    uint32_t Run(void* state, AST* regs, const AST* constants, AST false_value,
+                 AST true_value) const {
+        return reinterpret_cast<Entry>(pages_)(state, regs, constants, false_value, true_value);
+    }
+
+private:
+    void* pages_ = nullptr;
+    size_t size_ = 0;
+};
+
+// `steps` is indexed by opcode. The result is empty if the JIT is disabled at build time, or the
+// memory could not be mapped.
+MachineCode CompileMachineCode(const Bytecode& code, const StepFunc* steps);
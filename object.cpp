@@ -1,59 +1,112 @@
 #include <object.h>
+#include <bytecode.h>
+#include <context.h>
 #include <internal_funcs.h>
 #include <memory>
+#include <utility>
 #include <iostream>
 
-void Object::AddDependency(AST obj) {
-    ++dependencies_[obj];
+void Object::Trace(Tracer&) {
 }
 
-void Object::RemoveDependency(AST obj) {
-    auto it = dependencies_.find(obj);
-    if (it == dependencies_.end()) {
-        throw RuntimeError("There is no such a dependency");
-    }
-    --it->second;
-    if (it->second == 0) {
-        dependencies_.erase(it);
+Dispatcher::Dispatcher(Heap* heap, EvalContext* context, bool add_internal_funcs)
+    : Object(kType), prev_layer_(nullptr), heap_(heap), context_(context) {
+    if (add_internal_funcs) {
+        AddInternalFunctions();
     }
 }
 
-void Object::Mark() {
-    if (marked_) {
-        return;
+Dispatcher::Dispatcher(Dispatcher* prev_layer, Lambda* lambda)
+    : Object(kType),
+      prev_layer_(prev_layer),
+      heap_(prev_layer->heap_),
+      context_(prev_layer->context_),
+      lambda_(lambda),
+      slots_(lambda->GetNames().size(), this) {
+}
+
+ptrdiff_t Dispatcher::FindSlot(Symbol* name) const {
+    if (!lambda_) {
+        return -1;
     }
-    marked_ = true;
-    for (auto [ptr, cnt] : dependencies_) {
-        if (ptr) {
-            ptr->Mark();
+    const auto& names = lambda_->GetNames();
+    // Searching from the back lets the last of repeated parameters win.
+    for (auto i = static_cast<ptrdiff_t>(names.size()) - 1; i >= 0; --i) {
+        if (names[i] == name) {
+            return i;
         }
     }
+    return -1;
 }
 
-void Object::Unmark() {
-    marked_ = false;
+bool Dispatcher::IsBound(size_t slot) const {
+    return slots_[slot] != this;
 }
 
-bool Object::GetMarker() {
-    return marked_;
+AST Dispatcher::Resolve(Symbol* name) {
+    Dispatcher* cur_disp = this;
+    while (true) {
+        if (auto slot = cur_disp->FindSlot(name); slot >= 0 && cur_disp->IsBound(slot)) {
+            return cur_disp->slots_[slot];
+        }
+        if (!cur_disp->scope_.empty()) {
+            auto iter = cur_disp->scope_.find(name);
+            if (iter != cur_disp->scope_.end()) {
+                return iter->second->GetValue();
+            }
+        }
+        if (!cur_disp->prev_layer_) {
+            throw NameError("Can't resolve this name");
+        }
+        cur_disp = cur_disp->prev_layer_;
+    }
 }
 
-Dispatcher::Dispatcher(bool add_internal_funcs) : prev_layer_(nullptr) {
-    if (add_internal_funcs) {
-        AddInternalFunctions();
+Binding* Dispatcher::FindGlobal(Symbol* name) {
+    Dispatcher* cur_disp = this;
+    for (; cur_disp->prev_layer_; cur_disp = cur_disp->prev_layer_) {
+        if (cur_disp->FindSlot(name) >= 0 || cur_disp->scope_.contains(name)) {
+            return nullptr;
+        }
     }
+    auto iter = cur_disp->scope_.find(name);
+    return iter != cur_disp->scope_.end() ? iter->second : nullptr;
 }
 
-Dispatcher::Dispatcher(Dispatcher* prev_layer) : prev_layer_(prev_layer) {
-    AddDependency(prev_layer);
+void Dispatcher::Define(Symbol* name, AST obj) {
+    if (auto slot = FindSlot(name); slot >= 0) {
+        DefineLocal(slot, obj);
+        return;
+    }
+    name->MarkUserBound();
+    if (prev_layer_) {
+        name->MarkFrameBound();
+    }
+    Bind(name, obj);
 }
 
-AST Dispatcher::Resolve(const std::string& name) {
+void Dispatcher::Bind(Symbol* name, AST value) {
+    if (auto iter = scope_.find(name); iter != scope_.end()) {
+        iter->second->SetValue(value);
+        return;
+    }
+    auto binding = As<Binding>(heap_->MakeOld<Binding>(value));
+    scope_.emplace(name, binding);
+    Heap::WriteBarrier(this, name);
+    Heap::WriteBarrier(this, binding);
+}
+void Dispatcher::Set(Symbol* name, AST obj) {
     Dispatcher* cur_disp = this;
     while (true) {
+        if (auto slot = cur_disp->FindSlot(name); slot >= 0 && cur_disp->IsBound(slot)) {
+            cur_disp->DefineLocal(slot, obj);
+            return;
+        }
         auto iter = cur_disp->scope_.find(name);
         if (iter != cur_disp->scope_.end()) {
-            return iter->second;
+            name->MarkUserBound();
+            iter->second->SetValue(obj);
+            return;
         }
         if (!cur_disp->prev_layer_) {
             throw NameError("Can't resolve this name");
@@ -62,33 +115,70 @@ AST Dispatcher::Resolve(const std::string& name) {
     }
 }
 
-void Dispatcher::Define(const std::string& name, AST obj) {
-    auto it = scope_.find(name);
-    if (it != scope_.end()) {
-        RemoveDependency(it->second);
+AST Dispatcher::ResolveUnbound(size_t slot) {
+    if (!prev_layer_) {
+        throw NameError("Can't resolve this name");
     }
-    scope_[name] = obj;
-    AddDependency(obj);
+    return prev_layer_->Resolve(lambda_->GetNames()[slot]);
 }
-void Dispatcher::Set(const std::string& name, AST obj) {
-    Dispatcher* cur_disp = this;
-    while (true) {
-        auto iter = cur_disp->scope_.find(name);
-        if (iter != cur_disp->scope_.end()) {
-            cur_disp->RemoveDependency(iter->second);
-            iter->second = obj;
-            cur_disp->AddDependency(iter->second);
-            return;
-        }
-        if (!cur_disp->prev_layer_) {
+
+Dispatcher* Dispatcher::EnterFrame(Dispatcher* env, Lambda* lambda) {
+    auto& heap = env->GetHeap();
+    if (lambda->MakesClosures()) {
+        return As<Dispatcher>(heap.Make<Dispatcher>(env, lambda));
+    }
+    auto frame = heap.TakeSpareFrame();
+    if (!frame) {
+        // Spare frames never move, so they are not placed into the nursery.
+        frame = As<Dispatcher>(heap.MakeOld<Dispatcher>(env, lambda));
+    } else {
+        frame->prev_layer_ = env;
+        frame->lambda_ = lambda;
+        frame->slots_.assign(lambda->GetNames().size(), frame);
+        Heap::WriteBarrier(frame, env);
+        Heap::WriteBarrier(frame, lambda);
+    }
+    frame->recyclable_ = true;
+    return frame;
+}
+
+void Dispatcher::LeaveFrame() {
+    if (!recyclable_) {
+        return;
+    }
+    recyclable_ = false;
+    if (!scope_.empty()) {
+        scope_.clear();
+    }
+    prev_layer_ = nullptr;
+    lambda_ = nullptr;
+    slots_.clear();
+    heap_->AddSpareFrame(this);
+}
+
+void Dispatcher::Capture() {
+    recyclable_ = false;
+}
+
+void Dispatcher::DefineLocal(size_t slot, AST obj) {
+    slots_[slot] = obj;
+    Heap::WriteBarrier(this, obj);
+}
+
+void Dispatcher::SetLocal(size_t slot, AST obj) {
+    if (!IsBound(slot)) {
+        if (!prev_layer_) {
             throw NameError("Can't resolve this name");
         }
-        cur_disp = cur_disp->prev_layer_;
+        prev_layer_->Set(lambda_->GetNames()[slot], obj);
+        return;
     }
+    DefineLocal(slot, obj);
 }
+
 void Dispatcher::AddInternalFunctions() {
     // I'm really sorry for this one
-    std::unordered_map<std::string, Func> internal_funcs = {
+    std::unordered_map<std::string, NativeFunc> internal_funcs = {
         {"number?", &FuncIsNumber},
         {"pair?", &FuncIsPair},
         {"list?", &FuncIsList},
@@ -112,11 +202,7 @@ void Dispatcher::AddInternalFunctions() {
 
         {"abs", &FuncAbs},
 
-        {"quote", &FuncQuote},
-
         {"not", &FuncNot},
-        {"and", &FuncAnd},
-        {"or", &FuncOr},
 
         {"cons", &FuncCons},
         {"car", &FuncCar},
@@ -126,16 +212,30 @@ void Dispatcher::AddInternalFunctions() {
         {"list-ref", &FuncListRef},
         {"list-tail", &FuncListTail},
 
-        {"if", &FuncIf},
-        {"define", &FuncDefine},
-        {"set!", &FuncSet},
         {"set-car!", &FuncSetCar},
         {"set-cdr!", &FuncSetCdr},
-        {"lambda", &FuncLambda},
+
+        {"gc", &FuncGc},
     };
     for (const auto& [name, func] : internal_funcs) {
-        scope_[name] = GetHeap().Make<InternalFunction>(func);
-        AddDependency(scope_[name]);
+        Bind(heap_->Intern(name), heap_->Make<InternalFunction>(func));
+    }
+    std::unordered_map<std::string, Func> special_forms = {
+        {"quote", &FuncQuote},
+        {"define", &FuncDefine},
+        {"set!", &FuncSet},
+        {"lambda", &FuncLambda},
+    };
+    for (const auto& [name, func] : special_forms) {
+        Bind(heap_->Intern(name), heap_->Make<InternalFunction>(func));
+    }
+    std::unordered_map<std::string, TailFunc> tail_forms = {
+        {"if", &FuncIf},
+        {"and", &FuncAnd},
+        {"or", &FuncOr},
+    };
+    for (const auto& [name, func] : tail_forms) {
+        Bind(heap_->Intern(name), heap_->Make<InternalFunction>(func));
     }
 }
 
@@ -150,18 +250,75 @@ Dispatcher* Dispatcher::GetPrevDispatcher() {
     return prev_layer_;
 }
 
-AST Dispatcher::Clone() {
+Dispatcher* Dispatcher::GetFrame(size_t depth) {
+    Dispatcher* frame = this;
+    for (; depth > 0; --depth) {
+        frame = frame->prev_layer_;
+    }
+    return frame;
+}
+
+Heap& Dispatcher::GetHeap() {
+    return *heap_;
+}
+
+EvalContext& Dispatcher::GetContext() {
+    return *context_;
+}
+
+void Dispatcher::Trace(Tracer& tracer) {
+    for (auto& [name, obj] : scope_) {
+        // Symbols never move, so the key may be visited through a copy.
+        AST key = name;
+        tracer.Visit(key);
+        tracer.Visit(obj);
+    }
+    tracer.Visit(prev_layer_);
+    tracer.Visit(lambda_);
+    for (auto& obj : slots_) {
+        tracer.Visit(obj);
+    }
+}
+
+AST Dispatcher::Clone(Heap&) {
     throw RuntimeError("Can't clone dispatcher");
 }
 
+Binding::Binding(AST value) : Object(kType), value_(value) {
+}
+
+void Binding::SetValue(AST value) {
+    value_ = value;
+    Heap::WriteBarrier(this, value);
+}
+
+AST Binding::Compute(Dispatcher&) {
+    throw RuntimeError("Can't compute internal structure");
+}
+
+std::string Binding::Serialize() {
+    throw RuntimeError("Can't serialize internal structure");
+}
+
+AST Binding::Clone(Heap&) {
+    throw RuntimeError("Can't clone internal structure");
+}
+
+void Binding::Trace(Tracer& tracer) {
+    tracer.Visit(value_);
+}
+
 std::string SerializeExpr(AST tree) {
+    if (IsFixnum(tree)) {
+        return std::to_string(As<Number>(tree)->GetValue());
+    }
     if (tree) {
         return tree->Serialize();
     }
     return "()";
 }
 
-Number::Number(int64_t value) : value_(value) {
+Number::Number(int64_t value) : Object(kType), value_(value) {
 }
 
 int64_t Number::GetValue() const {
@@ -176,11 +333,31 @@ std::string Number::Serialize() {
     return std::to_string(value_);
 }
 
-AST Number::Clone() {
-    return GetHeap().Make<Number>(value_);
+AST Number::Clone(Heap& heap) {
+    return MakeNumber(heap, value_);
+}
+
+Boolean::Boolean(bool value) : Object(kType), value_(value) {
+}
+
+bool Boolean::GetValue() const {
+    return value_;
+}
+
+AST Boolean::Compute(Dispatcher&) {
+    return this;
 }
 
-Symbol::Symbol(std::string name) : name_(std::move(name)) {
+std::string Boolean::Serialize() {
+    return value_ ? kTrueStr : kFalseStr;
+}
+
+AST Boolean::Clone(Heap&) {
+    return this;
+}
+
+Symbol::Symbol(std::string name, uint32_t id)
+    : Object(kType), name_(std::move(name)), id_(id) {
 }
 
 const std::string& Symbol::GetName() const {
@@ -188,21 +365,18 @@ const std::string& Symbol::GetName() const {
 }
 
 AST Symbol::Compute(Dispatcher& dispatcher) {
-    if (name_ == "#t" || name_ == "#f") {
-        return GetHeap().Make<Symbol>(name_);
-    }
-    return dispatcher.Resolve(name_);
+    return dispatcher.Resolve(this);
 }
 
 std::string Symbol::Serialize() {
     return name_;
 }
 
-AST Symbol::Clone() {
-    return GetHeap().Make<Symbol>(name_);
+AST Symbol::Clone(Heap&) {
+    return this;
 }
 
-Cell::Cell() : first_(nullptr), second_(nullptr) {
+Cell::Cell() : Object(kType), first_(nullptr), second_(nullptr) {
 }
 
 AST Cell::GetFirst() const {
@@ -213,20 +387,18 @@ AST Cell::GetSecond() const {
     return second_;
 }
 void Cell::SetFirst(AST ptr) {
-    if (first_) {
-        RemoveDependency(first_);
-    }
     first_ = ptr;
-    AddDependency(ptr);
+    Heap::WriteBarrier(this, ptr);
 }
 void Cell::SetSecond(AST ptr) {
-    if (second_) {
-        RemoveDependency(second_);
-    }
     second_ = ptr;
-    AddDependency(second_);
+    Heap::WriteBarrier(this, ptr);
 }
-AST Cell::Clone() {
+void Cell::Trace(Tracer& tracer) {
+    tracer.Visit(first_);
+    tracer.Visit(second_);
+}
+AST Cell::Clone(Heap&) {
     throw RuntimeError("Can't clone a cell");
 }
 
@@ -267,15 +439,23 @@ ArgsVec ExtractProperListWithoutComputing(AST tree) {
     return data;
 }
 
-AST Cell::Compute(Dispatcher& dispatcher) {
+Function* Cell::ComputeFunction(Dispatcher& dispatcher) {
     if (!first_) {
         throw RuntimeError("Function is missing");
     }
-    auto func = As<Function>(first_->Compute(dispatcher));
+    auto func = As<Function>(ComputeExpr(dispatcher, first_));
     if (!func) {
         throw RuntimeError("This expression can't be used as a function");
     }
-    func = As<Function>(func->Clone());
+    // The state of a call lives in its frame, so the function is applied as it is.
+    return func;
+}
+
+AST Cell::Compute(Dispatcher& dispatcher) {
+    auto func = ComputeFunction(dispatcher);
+    if (auto internal = As<InternalFunction>(func); internal && internal->IsNative()) {
+        return internal->ApplyToList(dispatcher, second_);
+    }
     auto args_np = ExtractProperListWithoutComputing(second_);
     return func->Apply(dispatcher, args_np);
 }
@@ -291,7 +471,7 @@ std::string Cell::Serialize() {
         auto new_second = As<Cell>(cur_second)->GetSecond();
         if (new_second && !Is<Cell>(new_second)) {
             res += " . ";
-            res += new_second->Serialize();
+            res += SerializeExpr(new_second);
             break;
         } else {
             cur_second = new_second;
@@ -301,105 +481,476 @@ std::string Cell::Serialize() {
     return res;
 }
 
-InternalFunction::InternalFunction(const Func& func) : func_(func) {
+namespace {
+
+// The arguments of one native call on the argument stack of the interpreter. They are popped
+// when the call is over, also on errors.
+class ArgumentFrame {
+public:
+    explicit ArgumentFrame(EvalContext& context)
+        : stack_(context.GetArgumentStack()), base_(stack_.size()) {
+    }
+    ~ArgumentFrame() {
+        stack_.resize(base_);
+    }
+    void Push(AST value) {
+        stack_.push_back(value);
+    }
+    // Pushing more arguments may move the stack, so this is taken once all are computed.
+    ArgsSpan Get() const {
+        return {stack_.data() + base_, stack_.size() - base_};
+    }
+
+private:
+    RawVector<Object*>& stack_;
+    size_t base_;
+};
+
+}  // namespace
+
+InternalFunction::InternalFunction(const Func& func) : Function(kType), func_(func) {
+}
+InternalFunction::InternalFunction(const TailFunc& func) : Function(kType), tail_func_(func) {
+}
+InternalFunction::InternalFunction(const NativeFunc& func)
+    : Function(kType), native_func_(func) {
 }
 AST InternalFunction::Apply(Dispatcher& dispatcher, const ArgsVec& args) {
+    if (native_func_) {
+        ArgumentFrame frame(dispatcher.GetContext());
+        for (auto arg : args) {
+            frame.Push(ComputeExpr(dispatcher, arg));
+        }
+        return Call(dispatcher, frame.Get());
+    }
+    if (tail_func_) {
+        AST result;
+        if (ApplyTail(dispatcher, args, &result)) {
+            return ComputeExpr(dispatcher, result);
+        }
+        return result;
+    }
     return (*func_)(dispatcher, args);
 }
-AST InternalFunction::Clone() {
-    return GetHeap().Make<InternalFunction>(*func_);
+AST InternalFunction::ApplyToList(Dispatcher& dispatcher, AST args) {
+    // The same checks as ExtractProperListWithoutComputing, before anything is computed.
+    AST tail = args;
+    while (Is<Cell>(tail)) {
+        tail = As<Cell>(tail)->GetSecond();
+    }
+    if (tail) {
+        throw RuntimeError(kWrongArgs);
+    }
+    ArgumentFrame frame(dispatcher.GetContext());
+    for (; args; args = As<Cell>(args)->GetSecond()) {
+        frame.Push(ComputeExpr(dispatcher, As<Cell>(args)->GetFirst()));
+    }
+    return Call(dispatcher, frame.Get());
+}
+bool InternalFunction::IsTailForm() const {
+    return tail_func_;
+}
+bool InternalFunction::ApplyTail(Dispatcher& dispatcher, const ArgsVec& args, AST* result) {
+    return (*tail_func_)(dispatcher, args, result);
+}
+// Builtins keep no state of their own, so one object serves every application.
+AST InternalFunction::Clone(Heap&) {
+    return this;
 }
 
 AST Function::Compute(Dispatcher& dispatcher) {
     throw RuntimeError("Can't compute function");
 }
 
-CustomFunction::CustomFunction(Dispatcher& dispatcher, std::vector<std::string> args,
-                               std::vector<AST> commands)
-    : args_names_(std::move(args)),
-      commands_(std::move(commands)),
-      dispatcher_(As<Dispatcher>(GetHeap().Make<Dispatcher>(&dispatcher))) {
-    AddDependency(dispatcher_);
-    for (auto cmd : commands_) {
-        AddDependency(cmd);
-    }
+CustomFunction::CustomFunction(Dispatcher& env, Lambda* lambda)
+    : Function(kType), lambda_(lambda), env_(&env) {
+    env.Capture();
 }
 
-CustomFunction::CustomFunction(CustomFunction& other)
-    : args_names_(other.args_names_),
-      commands_(other.commands_),
-      dispatcher_(
-          As<Dispatcher>(GetHeap().Make<Dispatcher>(other.dispatcher_->GetPrevDispatcher()))) {
-    AddDependency(dispatcher_);
-    for (auto cmd : commands_) {
-        AddDependency(cmd);
+namespace {
+
+struct TailCall {
+    CustomFunction* func = nullptr;
+    ArgsVec args;
+};
+
+// Evaluates an expression in tail position. Special forms pass their own tail positions on, and
+// a call of a custom function is not made but left in `call`.
+AST ComputeTail(Dispatcher& dispatcher, AST expr, TailCall* call) {
+    while (true) {
+        if (auto form = As<SpecialForm>(expr)) {
+            if (form->IsShadowed()) {
+                expr = form->GetForm();
+            } else if (!form->ComputeTail(dispatcher, &expr)) {
+                return expr;
+            }
+            continue;
+        }
+        if (!Is<Cell>(expr)) {
+            return ComputeExpr(dispatcher, expr);
+        }
+        auto func = As<Cell>(expr)->ComputeFunction(dispatcher);
+        auto internal = As<InternalFunction>(func);
+        if (internal && internal->IsNative()) {
+            return internal->ApplyToList(dispatcher, As<Cell>(expr)->GetSecond());
+        }
+        auto args = ExtractProperListWithoutComputing(As<Cell>(expr)->GetSecond());
+        if (auto custom = As<CustomFunction>(func)) {
+            call->func = custom;
+            call->args = ComputeAll(dispatcher, args);
+            return nullptr;
+        }
+        if (!internal || !internal->IsTailForm()) {
+            return func->Apply(dispatcher, args);
+        }
+        if (!internal->ApplyTail(dispatcher, args, &expr)) {
+            return expr;
+        }
     }
 }
 
+}  // namespace
+
+// Calls in tail position replace the current one in this loop instead of nesting, so that
+// iterative procedures run in constant native stack.
 AST CustomFunction::Apply(Dispatcher& dispatcher, const ArgsVec& args_values) {
-    auto cmp_values = ComputeAll(dispatcher, args_values);
-    if (cmp_values.size() != args_names_.size()) {
-        throw RuntimeError(kWrongArgs);
+    auto& context = dispatcher.GetContext();
+    if (context.UsesBytecode()) {
+        auto args = ComputeAll(dispatcher, args_values);
+        return RunBytecode(this, args.data(), args.size());
     }
-    for (size_t i = 0; i < cmp_values.size(); ++i) {
-        dispatcher_->Define(args_names_[i], cmp_values[i]);
+    auto& stack = context.GetCallStack();
+    CallStack::Call depth{stack};
+    if (!stack.HasRoom()) {
+        return stack.Continue([&] { return Apply(dispatcher, args_values); });
+    }
+    TailCall call{this, ComputeAll(dispatcher, args_values)};
+    while (true) {
+        auto func = std::exchange(call.func, nullptr);
+        auto lambda = func->lambda_;
+        if (call.args.size() != lambda->GetParamsCount()) {
+            throw RuntimeError(kWrongArgs);
+        }
+        FrameGuard guard{Dispatcher::EnterFrame(func->env_, lambda)};
+        auto& frame = *guard.frame;
+        for (size_t i = 0; i < call.args.size(); ++i) {
+            frame.DefineLocal(i, call.args[i]);
+        }
+        const auto& body = lambda->GetBody();
+        for (size_t i = 0; i + 1 < body.size(); ++i) {
+            ComputeExpr(frame, body[i]);
+        }
+        auto result = ComputeTail(frame, body.back(), &call);
+        if (!call.func) {
+            return result;
+        }
+    }
+}
+
+// Closures are immutable, since every call gets a frame of its own.
+AST CustomFunction::Clone(Heap&) {
+    return this;
+}
+
+void CustomFunction::Trace(Tracer& tracer) {
+    tracer.Visit(lambda_);
+    tracer.Visit(env_);
+}
+
+SpecialForm::SpecialForm(ObjectType type, Symbol* keyword, AST form)
+    : Object(type), keyword_(keyword), form_(form) {
+}
+
+AST SpecialForm::GetForm() const {
+    return form_;
+}
+
+AST SpecialForm::Compute(Dispatcher& dispatcher) {
+    if (IsShadowed()) {
+        return form_->Compute(dispatcher);
     }
     AST result;
-    for (const auto& cmd : commands_) {
-        result = ComputeExpr(*dispatcher_, cmd);
+    if (ComputeTail(dispatcher, &result)) {
+        return ComputeExpr(dispatcher, result);
     }
     return result;
 }
 
-AST CustomFunction::Clone() {
-    return GetHeap().Make<CustomFunction>(*this);
+std::string SpecialForm::Serialize() {
+    if (!form_) {
+        throw RuntimeError("Can't serialize internal structure");
+    }
+    return SerializeExpr(form_);
 }
 
-std::string Function::Serialize() {
-    return "Just a function";
+AST SpecialForm::Clone(Heap&) {
+    return this;
 }
-AST ComputeExpr(Dispatcher& dispatcher, AST tree) {
-    if (tree) {
-        return tree->Compute(dispatcher);
-    }
-    return tree;
+
+void SpecialForm::Trace(Tracer& tracer) {
+    tracer.Visit(keyword_);
+    tracer.Visit(form_);
 }
-AST GetCopyOfExpr(AST tree) {
-    if (!tree) {
-        return tree;
+
+Lambda::Lambda(std::vector<Symbol*> names, size_t params_count, std::vector<AST> body,
+               bool makes_closures, std::unique_ptr<Bytecode> code, Symbol* keyword, AST form)
+    : SpecialForm(kType, keyword, form),
+      names_(std::move(names)),
+      params_count_(params_count),
+      body_(std::move(body)),
+      makes_closures_(makes_closures),
+      code_(std::move(code)) {
+}
+
+Lambda::Lambda(Lambda&&) = default;
+
+Lambda::~Lambda() = default;
+
+const std::vector<Symbol*>& Lambda::GetNames() const {
+    return names_;
+}
+
+size_t Lambda::GetParamsCount() const {
+    return params_count_;
+}
+
+const std::vector<AST>& Lambda::GetBody() const {
+    return body_;
+}
+
+bool Lambda::MakesClosures() const {
+    return makes_closures_;
+}
+
+bool Lambda::ComputeTail(Dispatcher& dispatcher, AST* result) {
+    *result = dispatcher.GetHeap().Make<CustomFunction>(dispatcher, this);
+    return false;
+}
+
+void Lambda::Trace(Tracer& tracer) {
+    SpecialForm::Trace(tracer);
+    for (auto& name : names_) {
+        tracer.Visit(name);
+    }
+    for (auto& cmd : body_) {
+        tracer.Visit(cmd);
     }
-    return tree->Clone();
+    code_->Trace(tracer);
 }
 
-namespace {
-std::unique_ptr<Heap> heap;
+IfForm::IfForm(Symbol* keyword, AST form, AST condition, AST consequent, AST alternative)
+    : SpecialForm(kType, keyword, form),
+      condition_(condition),
+      consequent_(consequent),
+      alternative_(alternative) {
+}
+
+AST IfForm::GetCondition() const {
+    return condition_;
+}
+
+AST IfForm::GetConsequent() const {
+    return consequent_;
+}
+
+AST IfForm::GetAlternative() const {
+    return alternative_;
 }
 
-Heap& GetHeap() {
-    if (!heap) {
-        heap = std::make_unique<Heap>();
+bool IfForm::ComputeTail(Dispatcher& dispatcher, AST* result) {
+    auto condition = ComputeExpr(dispatcher, condition_);
+    *result = condition != dispatcher.GetHeap().GetBoolean(false) ? consequent_ : alternative_;
+    return true;
+}
+
+void IfForm::Trace(Tracer& tracer) {
+    SpecialForm::Trace(tracer);
+    tracer.Visit(condition_);
+    tracer.Visit(consequent_);
+    tracer.Visit(alternative_);
+}
+
+AndForm::AndForm(Symbol* keyword, AST form, ArgsVec args, ObjectType type)
+    : SpecialForm(type, keyword, form), args_(std::move(args)) {
+}
+
+const ArgsVec& AndForm::GetArgs() const {
+    return args_;
+}
+
+bool AndForm::GetStopValue() const {
+    return GetType() == OrForm::kType;
+}
+
+bool AndForm::ComputeTail(Dispatcher& dispatcher, AST* result) {
+    auto stop = GetStopValue();
+    auto false_value = dispatcher.GetHeap().GetBoolean(false);
+    if (args_.empty()) {
+        *result = dispatcher.GetHeap().GetBoolean(!stop);
+        return false;
+    }
+    for (size_t i = 0; i + 1 < args_.size(); ++i) {
+        *result = ComputeExpr(dispatcher, args_[i]);
+        if ((*result != false_value) == stop) {
+            return false;
+        }
     }
-    return *heap;
+    *result = args_.back();
+    return true;
 }
 
-void Heap::Clean(Dispatcher* root) {
-    for (auto ptr : objects_) {
-        ptr->Unmark();
+void AndForm::Trace(Tracer& tracer) {
+    SpecialForm::Trace(tracer);
+    for (auto& arg : args_) {
+        tracer.Visit(arg);
     }
-    root->Mark();
-    for (auto it = objects_.begin(); it != objects_.end();) {
-        if ((*it)->GetMarker()) {
-            ++it;
+}
+
+OrForm::OrForm(Symbol* keyword, AST form, ArgsVec args)
+    : AndForm(keyword, form, std::move(args), kType) {
+}
+
+QuoteForm::QuoteForm(Symbol* keyword, AST form, AST datum)
+    : SpecialForm(kType, keyword, form), datum_(datum) {
+}
+
+AST QuoteForm::GetDatum() const {
+    return datum_;
+}
+
+bool QuoteForm::ComputeTail(Dispatcher&, AST* result) {
+    *result = datum_;
+    return false;
+}
+
+void QuoteForm::Trace(Tracer& tracer) {
+    SpecialForm::Trace(tracer);
+    tracer.Visit(datum_);
+}
+
+DefineForm::DefineForm(Symbol* keyword, AST form, AST target, AST value, ObjectType type)
+    : SpecialForm(type, keyword, form), target_(target), value_(value) {
+}
+
+AST DefineForm::GetTarget() const {
+    return target_;
+}
+
+AST DefineForm::GetValue() const {
+    return value_;
+}
+
+bool DefineForm::ComputeTail(Dispatcher& dispatcher, AST* result) {
+    auto value = ComputeExpr(dispatcher, value_);
+    auto ref = As<LocalRef>(target_);
+    if (GetType() == SetForm::kType) {
+        if (ref) {
+            ref->Set(dispatcher, value);
         } else {
-            delete *it;
-            it = objects_.erase(it);
+            dispatcher.Set(As<Symbol>(target_), value);
+        }
+    } else if (ref) {
+        ref->Define(dispatcher, value);
+    } else {
+        dispatcher.Define(As<Symbol>(target_), value);
+    }
+    *result = nullptr;
+    return false;
+}
+
+void DefineForm::Trace(Tracer& tracer) {
+    SpecialForm::Trace(tracer);
+    tracer.Visit(target_);
+    tracer.Visit(value_);
+}
+
+SetForm::SetForm(Symbol* keyword, AST form, AST target, AST value)
+    : DefineForm(keyword, form, target, value, kType) {
+}
+
+FoldedForm::FoldedForm(AST form, AST value, std::vector<Symbol*> names)
+    : SpecialForm(kType, nullptr, form), value_(value), names_(std::move(names)) {
+}
+
+AST FoldedForm::GetValue() const {
+    return value_;
+}
+
+const std::vector<Symbol*>& FoldedForm::GetNames() const {
+    return names_;
+}
+
+bool FoldedForm::ComputeTail(Dispatcher&, AST* result) {
+    for (auto name : names_) {
+        if (name->IsUserBound()) {
+            *result = GetForm();
+            return true;
         }
     }
+    *result = value_;
+    return false;
+}
+
+void FoldedForm::Trace(Tracer& tracer) {
+    SpecialForm::Trace(tracer);
+    tracer.Visit(value_);
+    for (auto& name : names_) {
+        tracer.Visit(name);
+    }
+}
+
+LocalRef::LocalRef(uint32_t depth, uint32_t slot, Symbol* name)
+    : Object(kType), depth_(depth), slot_(slot), name_(name) {
+}
+
+uint32_t LocalRef::GetDepth() const {
+    return depth_;
+}
+
+uint32_t LocalRef::GetSlot() const {
+    return slot_;
+}
+
+Symbol* LocalRef::GetName() const {
+    return name_;
+}
+
+AST LocalRef::Compute(Dispatcher& dispatcher) {
+    return dispatcher.GetFrame(depth_)->GetLocal(slot_);
+}
+
+void LocalRef::Define(Dispatcher& dispatcher, AST value) {
+    dispatcher.GetFrame(depth_)->DefineLocal(slot_, value);
+}
+
+void LocalRef::Set(Dispatcher& dispatcher, AST value) {
+    dispatcher.GetFrame(depth_)->SetLocal(slot_, value);
+}
+
+std::string LocalRef::Serialize() {
+    return name_->GetName();
 }
 
-void Heap::CleanAll() {
-    for (auto it = objects_.begin(); it != objects_.end(); ++it) {
-        delete *it;
+AST LocalRef::Clone(Heap&) {
+    return this;
+}
+
+void LocalRef::Trace(Tracer& tracer) {
+    tracer.Visit(name_);
+}
+
+std::string Function::Serialize() {
+    return "Just a function";
+}
+AST ComputeExpr(Dispatcher& dispatcher, AST tree) {
+    if (IsHeapObject(tree)) {
+        return tree->Compute(dispatcher);
     }
-    objects_.clear();
-}
\ No newline at end of file
+    return tree;
+}
+AST GetCopyOfExpr(Heap& heap, AST tree) {
+    if (!IsHeapObject(tree)) {
+        return tree;
+    }
+    return tree->Clone(heap);
+}
@@ -1,110 +1,568 @@
 #pragma once
 
 #include <functional>
-#include <set>
-#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <error.h>
+#include <heap.h>
 
 class Object;
 class Dispatcher;
+class Function;
+class Lambda;
+class EvalContext;
+struct Bytecode;
 
 using AST = Object*;
 using ArgsVec = std::vector<AST>;
+using ArgsSpan = std::span<const AST>;
 typedef AST (*Func)(Dispatcher&, const ArgsVec&);
+// Builtins which take their arguments computed. The arguments are only valid until the builtin
+// evaluates some expression itself.
+typedef AST (*NativeFunc)(Dispatcher&, ArgsSpan);
+// Special forms which end by evaluating one of their arguments return true and leave that
+// argument in `result`, for the caller to evaluate in tail position. Otherwise `result` is the
+// value.
+typedef bool (*TailFunc)(Dispatcher&, const ArgsVec&, AST* result);
 
 const std::string kWrongArgs = "Wrong function arguments";
+const std::string kTrueStr = "#t";
+const std::string kFalseStr = "#f";
 
 class Dispatcher;
 class Heap;
 
 std::string SerializeExpr(AST);
 
+class Tracer {
+public:
+    // Collectors may move objects, so fields are visited by reference.
+    virtual void Visit(AST& field) = 0;
+
+    template <class T>
+    requires(!std::is_same_v<T, Object>) void Visit(T*& field) {
+        AST obj = field;
+        Visit(obj);
+        field = static_cast<T*>(obj);
+    }
+
+protected:
+    ~Tracer() = default;
+};
+
+enum class ObjectType : uint8_t {
+    kNumber,
+    kBoolean,
+    kSymbol,
+    kCell,
+    kDispatcher,
+    kBinding,
+    kLocalRef,
+    // Subclasses of SpecialForm.
+    kLambda,
+    kIf,
+    kAnd,
+    kOr,
+    kQuote,
+    kDefine,
+    kSet,
+    kFolded,
+    // Subclasses of Function stay contiguous, so that Is<Function> is a range check.
+    kInternalFunction,
+    kCustomFunction,
+};
+
 class Object {
     friend Heap;
 
 public:
+    ObjectType GetType() const {
+        return type_;
+    }
     virtual AST Compute(Dispatcher& dispatcher) = 0;
     virtual std::string Serialize() = 0;
-    virtual AST Clone() = 0;
+    virtual AST Clone(Heap& heap) = 0;
     virtual ~Object() = default;
 
 protected:
-    void AddDependency(AST);
-    void RemoveDependency(AST);
-    void Mark();
-    void Unmark();
-    bool GetMarker();
+    explicit Object(ObjectType type) : type_(type) {
+    }
+    virtual void Trace(Tracer&);
 
 private:
-    std::map<AST, size_t> dependencies_;
-    bool marked_;
+    ObjectType type_;
+    uint8_t mark_epoch_ = 0;
+    bool remembered_ = false;
+    bool old_ = false;
 };
 
+inline void Heap::WriteBarrier(Object* holder, Object* value) {
+    if (!holder->old_) {
+        return;
+    }
+    auto& heap = *SlabPool::OwnerOf(holder);
+    if (IsHeapObject(value) && heap.nursery_.Contains(value)) {
+        heap.Remember(holder);
+    }
+    if (heap.phase_ == Phase::kMarking) {
+        heap.ShadeStored(holder, value);
+    }
+}
+
 class Number : public Object {
     friend Heap;
     Number(int64_t value);
+    Number(Number&&) = default;
 
 public:
+    static const ObjectType kType = ObjectType::kNumber;
     Number(const Number&) = delete;
     int64_t GetValue() const;
     AST Compute(Dispatcher& dispatcher);
     std::string Serialize();
-    AST Clone();
+    AST Clone(Heap& heap);
 
 private:
     int64_t value_;
 };
 
+// Integers which fit into 63 bits are never allocated: they are kept in the AST word itself,
+// shifted left by one and with the lowest bit set. Only larger ones are boxed into a Number.
+const int64_t kMaxFixnum = INT64_MAX >> 1;
+const int64_t kMinFixnum = INT64_MIN >> 1;
+
+inline bool IsFixnum(AST obj) {
+    return reinterpret_cast<uintptr_t>(obj) & 1;
+}
+
+inline AST MakeNumber(Heap& heap, int64_t value) {
+    if (value < kMinFixnum || value > kMaxFixnum) {
+        return heap.Make<Number>(value);
+    }
+    return reinterpret_cast<AST>(static_cast<uintptr_t>(value) << 1 | 1);
+}
+
+// As<Number> returns this instead of a pointer, since a fixnum has no object to point to.
+class NumberView {
+public:
+    explicit NumberView(AST obj)
+        : value_(IsFixnum(obj) ? reinterpret_cast<intptr_t>(obj) >> 1
+                               : static_cast<Number*>(obj)->GetValue()) {
+    }
+    int64_t GetValue() const {
+        return value_;
+    }
+    const NumberView* operator->() const {
+        return this;
+    }
+
+private:
+    int64_t value_;
+};
+
+class Boolean : public Object {
+    friend Heap;
+    explicit Boolean(bool value);
+    Boolean(Boolean&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kBoolean;
+    Boolean(const Boolean&) = delete;
+    bool GetValue() const;
+    AST Compute(Dispatcher& dispatcher);
+    std::string Serialize();
+    AST Clone(Heap& heap);
+
+private:
+    bool value_;
+};
+
+class Symbol : public Object {
+    friend Heap;
+    Symbol(std::string name, uint32_t id);
+    Symbol(Symbol&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kSymbol;
+    Symbol(const Symbol&) = delete;
+    const std::string& GetName() const;
+    // Assigned in interning order, and used to hash scope keys.
+    uint32_t GetId() const {
+        return id_;
+    }
+    // Set once the program binds the name in a scope, which compiled code cannot see lexically:
+    // the root one or that of a frame. Special forms whose keyword has been bound are applied as
+    // ordinary forms.
+    void MarkUserBound() {
+        user_bound_ = true;
+    }
+    bool IsUserBound() const {
+        return user_bound_;
+    }
+    // Set once the name is defined in the scope of a call frame rather than in the root one.
+    // References to global names no longer trust the bindings they have cached from then on.
+    void MarkFrameBound() {
+        frame_bound_ = true;
+    }
+    bool IsFrameBound() const {
+        return frame_bound_;
+    }
+    AST Compute(Dispatcher& dispatcher);
+    std::string Serialize();
+    AST Clone(Heap& heap);
+
+private:
+    std::string name_;
+    uint32_t id_;
+    bool user_bound_ = false;
+    bool frame_bound_ = false;
+};
+
+struct SymbolHash {
+    size_t operator()(const Symbol* symbol) const {
+        return symbol->GetId();
+    }
+};
+
+// The value of a name in the scope of a Dispatcher. Bindings live in the old space and never
+// move, so that compiled code may keep pointing to the ones of global names.
+class Binding : public Object {
+    friend Heap;
+    explicit Binding(AST value);
+    Binding(Binding&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kBinding;
+    Binding(const Binding&) = delete;
+    AST GetValue() const {
+        return value_;
+    }
+    void SetValue(AST value);
+    AST Compute(Dispatcher& dispatcher);
+    std::string Serialize();
+    AST Clone(Heap& heap);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    AST value_;
+};
+
+// A scope of names. Call frames also keep the parameters and local definitions of their lambda
+// in flat slots, which compiled code addresses by index.
 class Dispatcher : public Object {
     friend Heap;
-    explicit Dispatcher(bool add_internal_funcs);
-    explicit Dispatcher(Dispatcher*);
+    Dispatcher(Heap* heap, EvalContext* context, bool add_internal_funcs);
+    Dispatcher(Dispatcher* prev_layer, Lambda* lambda);
+    Dispatcher(Dispatcher&&) = default;
 
 public:
+    static const ObjectType kType = ObjectType::kDispatcher;
     Dispatcher(const Dispatcher&) = delete;
     AST Compute(Dispatcher& dispatcher);
     std::string Serialize();
-    AST Resolve(const std::string&);
-    void Define(const std::string&, AST);
-    void Set(const std::string&, AST);
+    AST Resolve(Symbol*);
+    // The binding of `name` in the root scope, provided that no frame on the way has a slot for
+    // the name, which makes the binding what Resolve finds for as long as the name is not
+    // defined in a frame. nullptr otherwise.
+    Binding* FindGlobal(Symbol* name);
+    void Define(Symbol*, AST);
+    void Set(Symbol*, AST);
+    // Slots which have not been assigned yet fall back to the enclosing scopes by name.
+    AST GetLocal(size_t slot) {
+        auto value = slots_[slot];
+        return value != this ? value : ResolveUnbound(slot);
+    }
+    void DefineLocal(size_t slot, AST);
+    void SetLocal(size_t slot, AST);
+    // Creates the frame for a call of `lambda` in `env`. Unless the lambda makes closures, the
+    // frame is taken from the spare frames of the heap and LeaveFrame gives it back, provided
+    // that nothing has captured it meanwhile.
+    static Dispatcher* EnterFrame(Dispatcher* env, Lambda* lambda);
+    void LeaveFrame();
+    // Called when a closure starts to refer to this scope.
+    void Capture();
     void AddInternalFunctions();
     Dispatcher* GetPrevDispatcher();
-    AST Clone();
+    Dispatcher* GetFrame(size_t depth);
+    Heap& GetHeap();
+    EvalContext& GetContext();
+    AST Clone(Heap& heap);
+
+protected:
+    void Trace(Tracer&);
 
 private:
-    std::unordered_map<std::string, AST> scope_;
+    // Index of the slot which holds `name`, or -1.
+    ptrdiff_t FindSlot(Symbol* name) const;
+    bool IsBound(size_t slot) const;
+    AST ResolveUnbound(size_t slot);
+    // Binds `name` in `scope_`, reusing its binding if it has one.
+    void Bind(Symbol* name, AST value);
+
+    std::unordered_map<Symbol*, Binding*, SymbolHash> scope_;
     Dispatcher* prev_layer_;
+    Heap* heap_;
+    EvalContext* context_;
+    Lambda* lambda_ = nullptr;
+    // An unassigned slot points to the frame itself, which is never a value. Slots of spare
+    // frames keep their capacity, and reusing it is not an allocation of the program.
+    RawVector<AST> slots_;
+    bool recyclable_ = false;
 };
 
-class Symbol : public Object {
+// Leaves the frame of a call once the call is over, also on errors.
+struct FrameGuard {
+    Dispatcher* frame;
+    ~FrameGuard() {
+        frame->LeaveFrame();
+    }
+};
+
+// A special form recognized by CompileLambda, which is evaluated directly instead of looking
+// its keyword up and applying the builtin.
+class SpecialForm : public Object {
     friend Heap;
-    Symbol(std::string name);
+
+protected:
+    // `form` is the original expression, evaluated instead if `keyword` gets bound by the
+    // program. Forms without a keyword of their own are always evaluated directly.
+    SpecialForm(ObjectType type, Symbol* keyword, AST form);
+    SpecialForm(SpecialForm&&) = default;
 
 public:
-    Symbol(const Symbol&) = delete;
-    const std::string& GetName() const;
+    SpecialForm(const SpecialForm&) = delete;
+    bool IsShadowed() const {
+        return keyword_ && keyword_->IsUserBound();
+    }
+    AST GetForm() const;
+    // Follows the contract of TailFunc.
+    virtual bool ComputeTail(Dispatcher& dispatcher, AST* result) = 0;
     AST Compute(Dispatcher& dispatcher);
     std::string Serialize();
-    AST Clone();
+    AST Clone(Heap& heap);
+
+protected:
+    void Trace(Tracer&);
 
 private:
-    std::string name_;
+    Symbol* keyword_;
+    AST form_;
+};
+
+// A lambda expression whose variables have been resolved by CompileLambda. The first
+// `params_count` names are the parameters, the rest are local definitions.
+class Lambda : public SpecialForm {
+    friend Heap;
+    Lambda(std::vector<Symbol*> names, size_t params_count, std::vector<AST> body,
+           bool makes_closures, std::unique_ptr<Bytecode> code, Symbol* keyword = nullptr,
+           AST form = nullptr);
+    Lambda(Lambda&&);
+
+public:
+    static const ObjectType kType = ObjectType::kLambda;
+    Lambda(const Lambda&) = delete;
+    ~Lambda();
+    const std::vector<Symbol*>& GetNames() const;
+    size_t GetParamsCount() const;
+    const std::vector<AST>& GetBody() const;
+    // Whether the body contains lambdas, which may keep the frame of a call alive.
+    bool MakesClosures() const;
+    // The body compiled for the VM.
+    const Bytecode& GetCode() const {
+        return *code_;
+    }
+    Bytecode& GetCode() {
+        return *code_;
+    }
+    bool ComputeTail(Dispatcher& dispatcher, AST* result);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    std::vector<Symbol*> names_;
+    size_t params_count_;
+    std::vector<AST> body_;
+    bool makes_closures_;
+    std::unique_ptr<Bytecode> code_;
+};
+
+class IfForm : public SpecialForm {
+    friend Heap;
+    IfForm(Symbol* keyword, AST form, AST condition, AST consequent, AST alternative);
+    IfForm(IfForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kIf;
+    AST GetCondition() const;
+    AST GetConsequent() const;
+    // nullptr if the form has none.
+    AST GetAlternative() const;
+    bool ComputeTail(Dispatcher& dispatcher, AST* result);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    AST condition_;
+    AST consequent_;
+    AST alternative_;
+};
+
+// `and` and `or`, which differ by the value which stops the evaluation.
+class AndForm : public SpecialForm {
+    friend Heap;
+
+protected:
+    AndForm(Symbol* keyword, AST form, ArgsVec args, ObjectType type = kType);
+    AndForm(AndForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kAnd;
+    const ArgsVec& GetArgs() const;
+    // The value which ends the evaluation early, and is the value of an empty form.
+    bool GetStopValue() const;
+    bool ComputeTail(Dispatcher& dispatcher, AST* result);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    ArgsVec args_;
+};
+
+class OrForm : public AndForm {
+    friend Heap;
+    OrForm(Symbol* keyword, AST form, ArgsVec args);
+    OrForm(OrForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kOr;
+};
+
+class QuoteForm : public SpecialForm {
+    friend Heap;
+    QuoteForm(Symbol* keyword, AST form, AST datum);
+    QuoteForm(QuoteForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kQuote;
+    AST GetDatum() const;
+    bool ComputeTail(Dispatcher& dispatcher, AST* result);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    AST datum_;
+};
+
+// `define` and `set!` of a single name. The target is either a LocalRef or a Symbol.
+class DefineForm : public SpecialForm {
+    friend Heap;
+
+protected:
+    DefineForm(Symbol* keyword, AST form, AST target, AST value, ObjectType type = kType);
+    DefineForm(DefineForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kDefine;
+    AST GetTarget() const;
+    AST GetValue() const;
+    bool ComputeTail(Dispatcher& dispatcher, AST* result);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    AST target_;
+    AST value_;
+};
+
+class SetForm : public DefineForm {
+    friend Heap;
+    SetForm(Symbol* keyword, AST form, AST target, AST value);
+    SetForm(SetForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kSet;
+};
+
+// A call of pure builtins over constants, computed by CompileLambda. Once the program binds one
+// of the names the value depends on in the root scope or in that of a frame, the original form
+// is evaluated instead.
+class FoldedForm : public SpecialForm {
+    friend Heap;
+    FoldedForm(AST form, AST value, std::vector<Symbol*> names);
+    FoldedForm(FoldedForm&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kFolded;
+    AST GetValue() const;
+    const std::vector<Symbol*>& GetNames() const;
+    bool ComputeTail(Dispatcher& dispatcher, AST* result);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    AST value_;
+    std::vector<Symbol*> names_;
+};
+
+// A variable kept in slot `slot` of the frame `depth` levels above the current one.
+class LocalRef : public Object {
+    friend Heap;
+    LocalRef(uint32_t depth, uint32_t slot, Symbol* name);
+    LocalRef(LocalRef&&) = default;
+
+public:
+    static const ObjectType kType = ObjectType::kLocalRef;
+    LocalRef(const LocalRef&) = delete;
+    uint32_t GetDepth() const;
+    uint32_t GetSlot() const;
+    Symbol* GetName() const;
+    AST Compute(Dispatcher& dispatcher);
+    void Define(Dispatcher& dispatcher, AST value);
+    void Set(Dispatcher& dispatcher, AST value);
+    std::string Serialize();
+    AST Clone(Heap& heap);
+
+protected:
+    void Trace(Tracer&);
+
+private:
+    uint32_t depth_;
+    uint32_t slot_;
+    Symbol* name_;
 };
 
 class Cell : public Object {
     friend Heap;
     Cell();
+    Cell(Cell&&) = default;
 
 public:
+    static const ObjectType kType = ObjectType::kCell;
     Cell(const Cell&) = delete;
     AST GetFirst() const;
     AST GetSecond() const;
     void SetFirst(AST ptr);
     void SetSecond(AST ptr);
+    // Computes the head of the application.
+    Function* ComputeFunction(Dispatcher& dispatcher);
     AST Compute(Dispatcher& dispatcher);
     std::string Serialize();
-    AST Clone();
+    AST Clone(Heap& heap);
+
+protected:
+    void Trace(Tracer&);
 
 private:
     AST first_;
@@ -118,6 +576,9 @@ ArgsVec ExtractProperListWithoutComputing(AST);
 class Function : public Object {
     friend Heap;
 
+protected:
+    using Object::Object;
+
 public:
     virtual AST Apply(Dispatcher&, const ArgsVec&) = 0;
     AST Compute(Dispatcher& dispatcher);
@@ -126,65 +587,114 @@ public:
 
 class InternalFunction : public Function {
     friend Heap;
+    InternalFunction(InternalFunction&&) = default;
 
 public:
+    static const ObjectType kType = ObjectType::kInternalFunction;
     InternalFunction(const InternalFunction&) = delete;
     InternalFunction(const Func&);
+    InternalFunction(const TailFunc&);
+    InternalFunction(const NativeFunc&);
     AST Apply(Dispatcher&, const ArgsVec&);
-    AST Clone();
+    bool IsTailForm() const;
+    bool ApplyTail(Dispatcher&, const ArgsVec&, AST* result);
+    bool IsNative() const {
+        return native_func_;
+    }
+    // Computes the arguments, given as the rest of an application, onto the argument stack of
+    // the heap and calls the native builtin with them.
+    AST ApplyToList(Dispatcher&, AST args);
+    AST Call(Dispatcher& dispatcher, ArgsSpan args) {
+        return native_func_(dispatcher, args);
+    }
+    Func GetFunc() const {
+        return func_;
+    }
+    TailFunc GetTailFunc() const {
+        return tail_func_;
+    }
+    NativeFunc GetNativeFunc() const {
+        return native_func_;
+    }
+    AST Clone(Heap& heap);
 
 private:
-    const Func func_;
+    const Func func_ = nullptr;
+    const TailFunc tail_func_ = nullptr;
+    const NativeFunc native_func_ = nullptr;
 };
 
 class CustomFunction : public Function {
     friend Heap;
-    CustomFunction(CustomFunction&);
-    CustomFunction(Dispatcher&, std::vector<std::string>, std::vector<AST>);
+    CustomFunction(CustomFunction&&) = default;
+    CustomFunction(Dispatcher&, Lambda*);
 
 public:
+    static const ObjectType kType = ObjectType::kCustomFunction;
+    CustomFunction(const CustomFunction&) = delete;
+    Lambda* GetLambda() const {
+        return lambda_;
+    }
+    Dispatcher* GetEnv() const {
+        return env_;
+    }
     AST Apply(Dispatcher&, const ArgsVec&);
-    AST Clone();
+    AST Clone(Heap& heap);
+
+protected:
+    void Trace(Tracer&);
 
 private:
-    std::vector<std::string> args_names_;
-    std::vector<AST> commands_;
-    Dispatcher* dispatcher_;
+    Lambda* lambda_;
+    Dispatcher* env_;
 };
 
 AST ComputeExpr(Dispatcher&, AST);
-AST GetCopyOfExpr(AST);
-
-class Heap {
-public:
-    template <class T, class... Args>
-    requires std::is_base_of_v<Object, T> AST Make(Args&&... args) {
-        AST ptr = new T(std::forward<Args>(args)...);
-        objects_.insert(ptr);
-        return ptr;
-    }
-    void Clean(Dispatcher* root);
-    void CleanAll();
-
-private:
-    std::set<AST> objects_;
-};
+AST GetCopyOfExpr(Heap&, AST);
 
-Heap& GetHeap();
 ///////////////////////////////////////////////////////////////////////////////
 
-// Runtime type checking and convertion.
-// This can be helpful: https://en.cppreference.com/w/cpp/memory/shared_ptr/pointer_cast
+// Runtime type checking and convertion, by the type tag of the object.
 
+// The tags which T and its subclasses may have.
 template <class T>
-requires std::is_base_of_v<Object, T> T* As(const AST& obj) {
-    return dynamic_cast<T*>(obj);
-}
+constexpr ObjectType kFirstType = T::kType;
+template <class T>
+constexpr ObjectType kLastType = T::kType;
+template <>
+constexpr ObjectType kFirstType<SpecialForm> = ObjectType::kLambda;
+template <>
+constexpr ObjectType kLastType<SpecialForm> = ObjectType::kFolded;
+template <>
+constexpr ObjectType kLastType<AndForm> = ObjectType::kOr;
+template <>
+constexpr ObjectType kLastType<DefineForm> = ObjectType::kSet;
+template <>
+constexpr ObjectType kFirstType<Function> = ObjectType::kInternalFunction;
+template <>
+constexpr ObjectType kLastType<Function> = ObjectType::kCustomFunction;
 
 template <class T>
 bool Is(const AST& obj) {
     if (!obj) {
         return false;
     }
-    return typeid(*obj) == typeid(T);
+    if (IsFixnum(obj)) {
+        return std::is_same_v<T, Number>;
+    }
+    auto type = obj->GetType();
+    if constexpr (kFirstType<T> == kLastType<T>) {
+        return type == kFirstType<T>;
+    } else {
+        return type >= kFirstType<T> && type <= kLastType<T>;
+    }
+}
+
+template <class T>
+requires std::is_base_of_v<Object, T> auto As(const AST& obj) {
+    if constexpr (std::is_same_v<T, Number>) {
+        return NumberView(obj);
+    } else {
+        return Is<T>(obj) ? static_cast<T*>(obj) : nullptr;
+    }
 }
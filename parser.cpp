@@ -3,9 +3,9 @@
 
 const std::string kQuoteStr = "quote";
 
-AST RecursiveRead(Tokenizer* tokenizer);
+AST RecursiveRead(BufferTokenizer* tokenizer, Heap* heap);
 
-AST ReadList(Tokenizer* tokenizer) {
+AST ReadList(BufferTokenizer* tokenizer, Heap* heap) {
     auto cur_token = tokenizer->GetToken();
     Cell* root_cell = nullptr;
     Cell* right_cell = nullptr;
@@ -21,7 +21,7 @@ AST ReadList(Tokenizer* tokenizer) {
                 if (tokenizer->IsEnd()) {
                     throw SyntaxError("Improper list initialization without second element");
                 }
-                auto v2 = RecursiveRead(tokenizer);
+                auto v2 = RecursiveRead(tokenizer, heap);
                 if (tokenizer->IsEnd()) {
                     throw SyntaxError("No matching close bracket");
                 }
@@ -33,12 +33,12 @@ AST ReadList(Tokenizer* tokenizer) {
                 right_cell->SetSecond(v2);
                 return root_cell;
             } else {
-                auto res = RecursiveRead(tokenizer);
+                auto res = RecursiveRead(tokenizer, heap);
                 if (!right_cell) {
-                    right_cell = As<Cell>(GetHeap().Make<Cell>());
+                    right_cell = As<Cell>(heap->Make<Cell>());
                     root_cell = right_cell;
                 } else {
-                    right_cell->SetSecond(GetHeap().Make<Cell>());
+                    right_cell->SetSecond(heap->Make<Cell>());
                     right_cell = As<Cell>(right_cell->GetSecond());
                 }
                 right_cell->SetFirst(res);
@@ -55,7 +55,7 @@ AST ReadList(Tokenizer* tokenizer) {
     }
 }
 
-AST RecursiveRead(Tokenizer* tokenizer) {
+AST RecursiveRead(BufferTokenizer* tokenizer, Heap* heap) {
     if (tokenizer->IsEnd()) {
         throw SyntaxError("Empty stream");
     }
@@ -64,21 +64,31 @@ AST RecursiveRead(Tokenizer* tokenizer) {
         if (std::get<BracketToken>(cur_token) == BracketToken::CLOSE) {
             throw SyntaxError("No matching open bracket");
         }
-        return ReadList(tokenizer);
+        return ReadList(tokenizer, heap);
     }
-    tokenizer->Next();
     if (std::holds_alternative<SymbolToken>(cur_token)) {
-        return GetHeap().Make<Symbol>(std::get<SymbolToken>(cur_token).name);
-    } else if (std::holds_alternative<ConstantToken>(cur_token)) {
-        return GetHeap().Make<Number>(std::get<ConstantToken>(cur_token).value);
+        // The name refers to the input, which the tokenizer may drop once it moves on.
+        auto name = std::get<SymbolToken>(cur_token).name;
+        AST atom = nullptr;
+        if (name == kTrueStr || name == kFalseStr) {
+            atom = heap->GetBoolean(name == kTrueStr);
+        } else {
+            atom = heap->Intern(name);
+        }
+        tokenizer->Next();
+        return atom;
+    }
+    tokenizer->Next();
+    if (std::holds_alternative<ConstantToken>(cur_token)) {
+        return MakeNumber(*heap, std::get<ConstantToken>(cur_token).value);
     } else if (std::holds_alternative<QuoteToken>(cur_token)) {
         if (tokenizer->IsEnd()) {
             throw SyntaxError("Expected expression after quote");
         }
-        auto inner_elem = RecursiveRead(tokenizer);
-        auto root = GetHeap().Make<Cell>();
-        As<Cell>(root)->SetFirst(GetHeap().Make<Symbol>(kQuoteStr));
-        As<Cell>(root)->SetSecond(GetHeap().Make<Cell>());
+        auto inner_elem = RecursiveRead(tokenizer, heap);
+        auto root = heap->Make<Cell>();
+        As<Cell>(root)->SetFirst(heap->Intern(kQuoteStr));
+        As<Cell>(root)->SetSecond(heap->Make<Cell>());
         As<Cell>(As<Cell>(root)->GetSecond())->SetFirst(inner_elem);
         return root;
     } else {
@@ -86,8 +96,8 @@ AST RecursiveRead(Tokenizer* tokenizer) {
     }
 }
 
-AST Read(Tokenizer* tokenizer) {
-    auto res = RecursiveRead(tokenizer);
+AST Read(BufferTokenizer* tokenizer, Heap* heap) {
+    auto res = RecursiveRead(tokenizer, heap);
     if (!tokenizer->IsEnd()) {
         throw SyntaxError("Extra symbols in input stream");
     }
@@ -3,4 +3,4 @@
 #include "object.h"
 #include <tokenizer.h>
 
-AST Read(Tokenizer* tokenizer);
\ No newline at end of file
+AST Read(BufferTokenizer* tokenizer, Heap* heap);
\ No newline at end of file
@@ -1,22 +1,28 @@
-#include <sstream>
-
 #include "scheme.h"
 
-Interpreter::Interpreter() : dispatcher_(As<Dispatcher>(GetHeap().Make<Dispatcher>(true))) {
+Interpreter::Interpreter()
+    : dispatcher_(As<Dispatcher>(heap_.MakeOld<Dispatcher>(&heap_, &context_, true))) {
 }
 
 std::string Interpreter::Run(const std::string& line) {
-    std::stringstream ss{line};
-    Tokenizer tokenizer(&ss);
-    auto ast = Read(&tokenizer);
+    BufferTokenizer tokenizer(line);
+    auto ast = Read(&tokenizer, &heap_);
     if (!ast) {
         throw RuntimeError("Unable to evaluate");
     }
-    auto str = SerializeExpr(ast->Compute(*dispatcher_));
-    GetHeap().Clean(dispatcher_);
+    auto str = SerializeExpr(ComputeExpr(*dispatcher_, ast));
+    heap_.Clean(dispatcher_);
     return str;
 }
 
-Interpreter::~Interpreter() {
-    GetHeap().CleanAll();
+void Interpreter::CollectGarbage() {
+    heap_.Collect(dispatcher_);
+}
+
+Heap& Interpreter::GetHeap() {
+    return heap_;
+}
+
+EvalContext& Interpreter::GetContext() {
+    return context_;
 }
\ No newline at end of file
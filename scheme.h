@@ -4,6 +4,7 @@
 #include <string>
 #include <unordered_map>
 
+#include <context.h>
 #include <object.h>
 #include <parser.h>
 
@@ -14,8 +15,12 @@ class Interpreter {
 public:
     Interpreter();
     std::string Run(const std::string&);
-    ~Interpreter();
+    void CollectGarbage();
+    Heap& GetHeap();
+    EvalContext& GetContext();
 
 private:
+    EvalContext context_;
+    Heap heap_;
     Dispatcher* dispatcher_;
 };
@@ -3,6 +3,12 @@ add_library(scheme_tidy
     parser.cpp
     scheme.cpp
     object.cpp
+    heap.cpp
     internal_funcs.cpp
+    compiler.cpp
+    bytecode.cpp
+    jit.cpp
+    stack.cpp
+    context.cpp
     # maybe more .cpp files here
 )
@@ -0,0 +1,166 @@
+#include <stack.h>
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <utility>
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <error.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define SCHEME_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SCHEME_ASAN
+#endif
+#endif
+
+#ifdef SCHEME_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+namespace {
+
+const std::string kTooDeep = "Maximum recursion depth exceeded";
+const std::string kUnknownStack = "Cannot find the bounds of the native stack";
+
+// The lowest page of a segment is left inaccessible, so that an overflow faults right away.
+size_t GuardSize() {
+    return sysconf(_SC_PAGESIZE);
+}
+
+struct Transfer {
+    Object* (*call)(void*);
+    void* arg;
+    Object* result = nullptr;
+    std::exception_ptr error = nullptr;
+    const void* caller_bottom = nullptr;
+    size_t caller_size = 0;
+};
+
+// makecontext only passes int arguments, hence the pointer in two halves. Exceptions must not
+// leave the segment, so they are rethrown on the caller's stack.
+void EnterSegment(unsigned high, unsigned low) {
+    auto transfer = reinterpret_cast<Transfer*>(uintptr_t{high} << 32 | low);
+#ifdef SCHEME_ASAN
+    __sanitizer_finish_switch_fiber(nullptr, &transfer->caller_bottom, &transfer->caller_size);
+#endif
+    try {
+        transfer->result = transfer->call(transfer->arg);
+    } catch (...) {
+        transfer->error = std::current_exception();
+    }
+#ifdef SCHEME_ASAN
+    __sanitizer_start_switch_fiber(nullptr, transfer->caller_bottom, transfer->caller_size);
+#endif
+}
+
+// getcontext returns twice, so it is kept out of the caller, whose locals could otherwise be
+// clobbered. The context is filled in place, as it refers to its own storage.
+[[gnu::noinline]] void PrepareSegment(ucontext_t* callee, void* pages, ucontext_t* caller,
+                                      Transfer* transfer) {
+    getcontext(callee);
+    callee->uc_stack.ss_sp = pages;
+    callee->uc_stack.ss_size = kStackSegmentSize;
+    callee->uc_link = caller;
+    auto address = reinterpret_cast<uintptr_t>(transfer);
+    makecontext(callee, reinterpret_cast<void (*)()>(&EnterSegment), 2,
+                static_cast<unsigned>(address >> 32), static_cast<unsigned>(address));
+}
+
+}  // namespace
+
+CallStack::~CallStack() {
+    if (spare_) {
+        munmap(spare_, kStackSegmentSize);
+    }
+}
+
+char* CallStack::GetThreadLimit() {
+    thread_local char* limit = FindThreadLimit();
+    return limit;
+}
+
+char* CallStack::FindThreadLimit() {
+    pthread_attr_t attr;
+    void* addr = nullptr;
+    size_t size = 0;
+    if (!pthread_getattr_np(pthread_self(), &attr)) {
+        if (pthread_attr_getstack(&attr, &addr, &size)) {
+            addr = nullptr;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if (!addr) {
+        // The stack starts a little above this frame, which the reserve below the limit covers.
+        rlimit limit;
+        if (getrlimit(RLIMIT_STACK, &limit) || limit.rlim_cur == RLIM_INFINITY) {
+            throw RuntimeError(kUnknownStack);
+        }
+        addr = static_cast<char*>(__builtin_frame_address(0)) - limit.rlim_cur;
+    }
+    return static_cast<char*>(addr) + GuardSize() + kStackReserve;
+}
+
+void CallStack::ThrowTooDeep() {
+    throw RuntimeError(kTooDeep);
+}
+
+Object* CallStack::RunOnNewSegment(Object* (*call)(void*), void* arg) {
+    auto pages = TakeSegment();
+    ucontext_t caller;
+    ucontext_t callee;
+    Transfer transfer{call, arg};
+    PrepareSegment(&callee, pages, &caller, &transfer);
+
+    auto limit = std::exchange(limit_, static_cast<char*>(pages) + GuardSize() + kStackReserve);
+    --depth_;
+    ++segments_;
+#ifdef SCHEME_ASAN
+    void* fake_stack = nullptr;
+    __sanitizer_start_switch_fiber(&fake_stack, pages, kStackSegmentSize);
+#endif
+    swapcontext(&caller, &callee);
+#ifdef SCHEME_ASAN
+    __sanitizer_finish_switch_fiber(fake_stack, nullptr, nullptr);
+#endif
+    --segments_;
+    ++depth_;
+    limit_ = limit;
+    ReleaseSegment(pages);
+
+    if (transfer.error) {
+        std::rethrow_exception(transfer.error);
+    }
+    return transfer.result;
+}
+
+void* CallStack::TakeSegment() {
+    if (auto pages = std::exchange(spare_, nullptr)) {
+        return pages;
+    }
+    auto pages = mmap(nullptr, kStackSegmentSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (pages == MAP_FAILED) {
+        ThrowTooDeep();
+    }
+    if (mprotect(pages, GuardSize(), PROT_NONE)) {
+        munmap(pages, kStackSegmentSize);
+        ThrowTooDeep();
+    }
+    return pages;
+}
+
+void CallStack::ReleaseSegment(void* pages) {
+    if (spare_) {
+        munmap(pages, kStackSegmentSize);
+    } else {
+        spare_ = pages;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+class Object;
+
+const size_t kMaxDepth = 1 << 18;
+// Native stack for deep recursion is mapped in segments of this size, committed lazily.
+const size_t kStackSegmentSize = 1 << 24;
+// A call moves on to a new segment unless this much of the current one is left.
+const size_t kStackReserve = 1 << 18;
+
+// The calls of lambdas in progress. Both evaluators recurse natively for calls which are not in
+// tail position, so each such call checks the room left on the native stack, and continues on a
+// fresh segment once the thread's own stack (or the current segment) is about to run out. The
+// depth is thus only bounded by the limit, beyond which calls raise RuntimeError.
+class CallStack {
+public:
+    CallStack() = default;
+    CallStack(const CallStack&) = delete;
+    CallStack& operator=(const CallStack&) = delete;
+    ~CallStack();
+
+    // Counts a call for as long as it runs.
+    class Call {
+    public:
+        explicit Call(CallStack& stack) : stack_(stack) {
+            // The outermost call runs on the stack of whichever thread makes it.
+            if (stack.depth_ == 0 && !stack.segments_) {
+                stack.limit_ = GetThreadLimit();
+            }
+            if (stack.depth_ == stack.max_depth_) {
+                ThrowTooDeep();
+            }
+            ++stack.depth_;
+        }
+        Call(const Call&) = delete;
+        Call& operator=(const Call&) = delete;
+        ~Call() {
+            --stack_.depth_;
+        }
+
+    private:
+        CallStack& stack_;
+    };
+
+    void SetMaxDepth(size_t calls) {
+        max_depth_ = calls;
+    }
+    size_t GetMaxDepth() const {
+        return max_depth_;
+    }
+
+    [[gnu::always_inline]] bool HasRoom() const {
+        return static_cast<char*>(__builtin_frame_address(0)) >= limit_;
+    }
+
+    // Makes the current call, which has no room left, over again on a new segment: `call` is
+    // counted there instead.
+    template <class F>
+    Object* Continue(F&& call) {
+        using Body = std::remove_reference_t<F>;
+        return RunOnNewSegment([](void* call) { return (*static_cast<Body*>(call))(); }, &call);
+    }
+
+private:
+    // The calling thread's own stack is used down to this address. It is found once per thread.
+    static char* GetThreadLimit();
+    static char* FindThreadLimit();
+    [[noreturn]] static void ThrowTooDeep();
+    Object* RunOnNewSegment(Object* (*call)(void*), void* arg);
+    void* TakeSegment();
+    void ReleaseSegment(void* pages);
+
+    size_t depth_ = 0;
+    size_t max_depth_ = kMaxDepth;
+    // Calls whose frame would lie below this address go to a new segment.
+    char* limit_ = nullptr;
+    // Segments in use by the calls in progress.
+    size_t segments_ = 0;
+    // A segment is kept after use, so that recursion which goes back and forth across the end of
+    // a segment does not map and unmap one on every call.
+    void* spare_ = nullptr;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <iostream>
+
 #include <catch.hpp>
 
 #include <error.h>
@@ -28,12 +30,27 @@ public:
         REQUIRE_THROWS_AS(interpreter_.Run(expression), NameError);
     }
 
+    Heap& GetHeap() {
+        return interpreter_.GetHeap();
+    }
+
+    EvalContext& GetContext() {
+        return interpreter_.GetContext();
+    }
+
+    // Objects are not allocated through operator new, so leaks show up here instead.
+    size_t LiveBytes() {
+        interpreter_.CollectGarbage();
+        return GetHeap().GetLiveBytes();
+    }
+
 private:
     Interpreter interpreter_;
 };
 
 #define WITH_ALLOCATION_DIFFERENCE_CHECK(max_expected_diff, expression)                            \
     do {                                                                                           \
+        size_t live_bytes = LiveBytes();                                                           \
         alloc_checker::ResetCounters();                                                            \
                                                                                                    \
         expression;                                                                                \
@@ -47,4 +64,5 @@ private:
                                                                                                    \
         REQUIRE(diff >= 0);                                                                        \
         REQUIRE(diff <= max_expected_diff);                                                        \
+        REQUIRE(LiveBytes() <= live_bytes + (max_expected_diff) * kSlotGranularity);               \
     } while (false);
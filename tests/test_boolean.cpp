@@ -58,3 +58,14 @@ TEST_CASE_METHOD(SchemeTest, "OrSyntax") {
     ExpectEq("(or #f (< 2 1))", "#f");
     ExpectEq("(or #f 1)", "1");
 }
+
+TEST_CASE_METHOD(SchemeTest, "BooleansAreConstants") {
+    ExpectEq("(symbol? #t)", "#f");
+    ExpectEq("(boolean? (< 1 2))", "#t");
+    ExpectEq("'(#t . #f)", "(#t . #f)");
+    ExpectEq("(if '() 1 2)", "1");
+    ExpectNoError("(define yes (= 1 1))");
+    ExpectNoError("(gc)");
+    ExpectEq("yes", "#t");
+    ExpectEq("(not yes)", "#f");
+}
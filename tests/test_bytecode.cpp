@@ -0,0 +1,207 @@
+#include <sstream>
+#include <string>
+
+#include "scheme_test.h"
+
+TEST_CASE_METHOD(SchemeTest, "RebindingBuiltinsAfterCompilation") {
+    ExpectNoError("(define (f x) (if (< x 0) (- 0 x) (+ x 1)))");
+    ExpectEq("(f 2)", "3");
+    ExpectNoError("(define + *)");
+    ExpectEq("(f 2)", "2");
+    ExpectNoError("(define (if a b c) b)");
+    ExpectEq("(f 2)", "-2");
+    ExpectNoError("(define if and)");
+    ExpectEq("(f 2)", "#f");
+    ExpectEq("(f -2)", "-2");
+}
+
+TEST_CASE_METHOD(SchemeTest, "SpecialFormsShadowedAtRunTime") {
+    ExpectNoError("(define (f x) (define quote (lambda (y) (* y 2))) (quote x))");
+    ExpectEq("(f 21)", "42");
+    ExpectNoError("(define (g x) (if (quote x) 1 2))");
+    ExpectEq("(g 3)", "1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ParametersOnlyShadowKeywordsLexically") {
+    ExpectNoError("(define (f if and) (if (and 1 2) 3))");
+    ExpectEq("(f + *)", "5");
+    ExpectNoError("(define make lambda)");
+    ExpectNoError("(define (g if) ((make () (if 1 2))))");
+    ExpectEq("(g -)", "-1");
+    ExpectNoError("(define (h x) (if (and x 1) 2 3))");
+    ExpectEq("(h #f)", "3");
+    REQUIRE_FALSE(GetHeap().Intern("if")->IsUserBound());
+    REQUIRE_FALSE(GetHeap().Intern("and")->IsUserBound());
+}
+
+TEST_CASE_METHOD(SchemeTest, "ErrorsMatchTreeWalking") {
+    ExpectNoError("(define (add x y) (+ x y))");
+    ExpectNoError("(define (call f) (f 1))");
+    ExpectNoError("(define (improper x) (add x . x))");
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectRuntimeError("(add 1 #t)");
+        ExpectRuntimeError("(add 1)");
+        ExpectRuntimeError("(call 5)");
+        ExpectRuntimeError("(improper 1)");
+        ExpectNameError("(call (lambda (x) y))");
+        ExpectSyntaxError("(call (lambda (x) (if x)))");
+        ExpectEq("(call (lambda (x) (quote x)))", "x");
+    }
+}
+
+TEST_CASE_METHOD(SchemeTest, "TreeWalkingEvaluator") {
+    GetContext().SetBytecode(false);
+    ExpectNoError("(define (fib x) (if (< x 3) 1 (+ (fib (- x 1)) (fib (- x 2)))))");
+    ExpectEq("(fib 15)", "610");
+    ExpectNoError("(define (make-acc x) (lambda (y) (set! x (+ x y)) x))");
+    ExpectNoError("(define acc (make-acc 10))");
+    ExpectEq("(acc 5)", "15");
+    GetContext().SetBytecode(true);
+    ExpectEq("(acc 5)", "20");
+    ExpectEq("(fib 15)", "610");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ManyRegisters") {
+    std::string sum = "x";
+    for (int i = 0; i < 100; ++i) {
+        sum = "(+ 1 " + sum + ")";
+    }
+    ExpectNoError("(define (f x) " + sum + ")");
+    ExpectEq("(f 1)", "101");
+
+    std::string args;
+    for (int i = 0; i < 100; ++i) {
+        args += " x";
+    }
+    ExpectNoError("(define (g x) (+" + args + "))");
+    ExpectEq("(g 2)", "200");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ConstantFolding") {
+    std::ostringstream dump;
+    GetContext().SetFolding(true, &dump);
+    ExpectNoError("(define (day) (* 60 60 (+ 20 4)))");
+    ExpectNoError("(define (f x) (if (< (abs -3) (max 1 4)) x (not (= 1 '1))))");
+    ExpectNoError("(define (g x) (+ 1 #t))");
+    ExpectNoError("(define (h x) (+ x (* 2 3)))");
+    REQUIRE(dump.str() ==
+            "(* 60 60 (+ 20 4)) => 86400\n"
+            "(< (abs -3) (max 1 4)) => #t\n"
+            "(not (= 1 (quote 1))) => #f\n"
+            "(* 2 3) => 6\n");
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectEq("(day)", "86400");
+        ExpectEq("(f 5)", "5");
+        ExpectRuntimeError("(g 1)");
+        ExpectEq("(h 1)", "7");
+    }
+
+    ExpectNoError("(define max min)");
+    ExpectNoError("(define * +)");
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectEq("(day)", "144");
+        ExpectEq("(f 5)", "#f");
+        ExpectEq("(h 1)", "6");
+    }
+
+    dump.str("");
+    GetContext().SetFolding(false, &dump);
+    ExpectNoError("(define (k) (+ 1 2))");
+    ExpectEq("(k)", "3");
+    REQUIRE(dump.str().empty());
+}
+
+TEST_CASE_METHOD(SchemeTest, "MachineCode") {
+    GetContext().SetJitThreshold(1);
+    ExpectNoError("(define (fib x) (if (< x 3) 1 (+ (fib (- x 1)) (fib (- x 2)))))");
+    ExpectEq("(fib 20)", "6765");
+    ExpectNoError("(define (slow-add x y) (if (= x 0) y (slow-add (- x 1) (+ y 1))))");
+    ExpectEq("(slow-add 10000 1)", "10001");
+    ExpectNoError("(define (cmp x y) (and (<= x y) (>= y x) (not (> x y)) (not (< y x))))");
+    ExpectEq("(cmp 2 2)", "#t");
+    ExpectEq("(cmp -5 3)", "#t");
+    ExpectEq("(cmp 3 -5)", "#f");
+    const auto& jit = GetContext().GetJitStats();
+#ifdef SCHEME_JIT
+    REQUIRE(jit.compiled > 0);
+#else
+    REQUIRE(jit.compiled == 0);
+#endif
+    REQUIRE(jit.deopts == 0);
+
+    // Operands which are no fixnums and results which overflow them leave the rest of the call
+    // to the interpreter.
+    ExpectNoError("(define (mul x y) (* x y))");
+    ExpectEq("(mul 3 -4)", "-12");
+    ExpectEq("(mul 4611686018427387903 2)", "9223372036854775806");
+    ExpectEq("(mul (mul 4611686018427387903 2) 1)", "9223372036854775806");
+    ExpectEq("(slow-add 2 4611686018427387902)", "4611686018427387904");
+    ExpectRuntimeError("(mul 1 #t)");
+    ExpectEq("(mul 5 6)", "30");
+#ifdef SCHEME_JIT
+    REQUIRE(jit.deopts > 0);
+#else
+    REQUIRE(jit.deopts == 0);
+#endif
+
+    // Errors of the instructions left to the interpreter.
+    ExpectNoError("(define (f x) (if x (g x) (f (car x))))");
+    ExpectNameError("(f 1)");
+    ExpectRuntimeError("(f #f)");
+    ExpectNoError("(define (g x) (- 0 x))");
+    ExpectEq("(f 1)", "-1");
+
+    ExpectNoError("(define + -)");
+    ExpectEq("(fib 10)", "-1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ParametersKeepFolding") {
+    std::ostringstream dump;
+    GetContext().SetFolding(true, &dump);
+    ExpectNoError("(define (f) (max 1 2))");
+    ExpectNoError("(define (clamp x min max) (if (< x min) min (if (> x max) max x)))");
+    ExpectEq("(clamp 5 1 3)", "3");
+    ExpectNoError("(define (g) (+ (max 1 2) (min 3 4)))");
+    REQUIRE(dump.str() ==
+            "(max 1 2) => 2\n"
+            "(+ (max 1 2) (min 3 4)) => 5\n");
+    // The folded forms keep their values rather than computing the original ones again.
+    REQUIRE_FALSE(GetHeap().Intern("max")->IsUserBound());
+    REQUIRE_FALSE(GetHeap().Intern("min")->IsUserBound());
+    ExpectEq("(f)", "2");
+    ExpectEq("(g)", "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "CachedGlobalBindings") {
+    ExpectNoError("(define x 1)");
+    ExpectNoError("(define (get) x)");
+    ExpectEq("(get)", "1");
+    ExpectNoError("(define x 2)");
+    ExpectEq("(get)", "2");
+    ExpectNoError("(set! x 3)");
+    ExpectEq("(get)", "3");
+    ExpectNoError("(define (put v) (set! x v))");
+    ExpectNoError("(put 4)");
+    ExpectEq("(get)", "4");
+
+    // Definitions in the scope of a frame shadow the global binding for the code running in it.
+    ExpectNoError("(define def define)");
+    ExpectNoError("(define (shadow v) (def x v) (lambda () x))");
+    ExpectNoError("(define (use f) (f))");
+    ExpectEq("(use get)", "4");
+    ExpectNoError("(define inner (shadow 5))");
+    ExpectEq("(inner)", "5");
+    ExpectEq("(use inner)", "5");
+    ExpectEq("(get)", "4");
+    ExpectNoError("(define x 6)");
+    ExpectEq("(get)", "6");
+    ExpectEq("(inner)", "5");
+
+    ExpectNoError("(define (unbound) y)");
+    ExpectNameError("(unbound)");
+    ExpectNoError("(define y 7)");
+    ExpectEq("(unbound)", "7");
+}
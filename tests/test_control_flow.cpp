@@ -21,3 +21,32 @@ TEST_CASE_METHOD(SchemeTest, "IfSyntax") {
     ExpectSyntaxError("(if)");
     ExpectSyntaxError("(if 1 2 3 4)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "SpecialFormsInLambdas") {
+    ExpectNoError("(define x 1)");
+    ExpectNoError("(define (f c) (if c (set! x (+ x 1))) (define y (and c x)) (or y 'none))");
+    ExpectNoError("(define (g) (list (and) (or) '(if a b) (if #f #f)))");
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectEq("(f #f)", "none");
+        ExpectEq("(f #t)", bytecode ? "2" : "3");
+        ExpectEq("(g)", "(#t #f (if a b) ())");
+    }
+}
+
+TEST_CASE_METHOD(SchemeTest, "RebindingSpecialForms") {
+    ExpectNoError("(define (f x) (if x (quote 1) (quote 2)))");
+    ExpectNoError("(define (g x) (set! x 2) x)");
+    ExpectNoError("(define (h) (lambda (k) 3))");
+    ExpectNoError("(define if (lambda (c a b) (list c a b)))");
+    ExpectNoError("(define (quote x) (* x 2))");
+    ExpectNoError("(define set! +)");
+    ExpectNoError("(define lambda -)");
+    ExpectNoError("(define (k) 10)");
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectEq("(f 1)", "(1 2 4)");
+        ExpectEq("(g 5)", "5");
+        ExpectEq("(h)", "7");
+    }
+}
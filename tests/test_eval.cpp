@@ -1,3 +1,5 @@
+#include <string>
+
 #include "scheme_test.h"
 
 TEST_CASE_METHOD(SchemeTest, "Quote") {
@@ -11,3 +13,36 @@ TEST_CASE_METHOD(SchemeTest, "Be careful") {
     ExpectRuntimeError("('() ())");
     ExpectEq("'(())", "(())");
 }
+
+TEST_CASE_METHOD(SchemeTest, "BuiltinCallsMakeNoObjects") {
+    ExpectNoError("(define x '(1 2 3))");
+    ExpectNoError("(define (loop n) (if (and (list? x) (= n 0)) (car x) (loop (- n (car x)))))");
+    auto objects_made = [&](const std::string& expression) {
+        auto before = GetHeap().GetStats().objects_made;
+        ExpectEq(expression, "1");
+        return GetHeap().GetStats().objects_made - before;
+    };
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectEq("(loop 1)", "1");
+        WITH_ALLOCATION_DIFFERENCE_CHECK(0, {
+            REQUIRE(objects_made("(loop 10)") == objects_made("(loop 10000)"));
+        });
+    }
+}
+
+TEST_CASE_METHOD(SchemeTest, "BuiltinCallsAllocateNothing") {
+    ExpectNoError("(define x '(1 2 3))");
+    ExpectNoError("(define (f) (+ (abs (- 1 2)) (car x) (max 1 (car (cdr x)) 3)))");
+    ExpectNoError("(define (g) 5)");
+    auto allocations = [&](const std::string& expression) {
+        ExpectEq(expression, "5");
+        alloc_checker::ResetCounters();
+        ExpectEq(expression, "5");
+        return alloc_checker::AllocCount();
+    };
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        REQUIRE(allocations("(f)") == allocations("(g)"));
+    }
+}
@@ -21,8 +21,9 @@ TEST_CASE("Fuzzing-1") {
 #endif
             std::stringstream ss{req};
             Tokenizer tokenizer{&ss};
+            Heap heap;
             while (!tokenizer.IsEnd()) {
-                Read(&tokenizer);
+                Read(&tokenizer, &heap);
             }
         } catch (const SyntaxError&) {
         }
@@ -8,6 +8,7 @@
 #include <iostream>
 
 static constexpr uint32_t kShotsCount = 100000;
+static constexpr size_t kMaxLiveBytes = 1 << 16;
 
 TEST_CASE("Fuzzing-2") {
     Fuzzer fuzzer;
@@ -34,8 +35,14 @@ TEST_CASE("Fuzzing-2") {
     std::cerr << "Fuzzer:\n";
     std::cerr << "Allocations: " << alloc_count << "\n";
     std::cerr << "Deallocations: " << dealloc_count << "\n";
-    std::cerr << "Difference: " << diff << "\n\n";
+    std::cerr << "Difference: " << diff << "\n";
+
+    // Objects themselves are not allocated through operator new, so they are bounded separately.
+    interpreter.CollectGarbage();
+    auto live_bytes = interpreter.GetHeap().GetLiveBytes();
+    std::cerr << "Live bytes: " << live_bytes << "\n\n";
 
     // If falling here, check that you invoke GC after each command
     REQUIRE(alloc_count - dealloc_count <= 10'000);
+    REQUIRE(live_bytes <= kMaxLiveBytes);
 }
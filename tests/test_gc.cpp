@@ -0,0 +1,152 @@
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scheme_test.h"
+
+TEST_CASE_METHOD(SchemeTest, "OldCellsKeepYoungValues") {
+    ExpectNoError("(define x '(1 2 3))");
+    ExpectNoError("(define counter 0)");
+    for (int i = 0; i < 50; ++i) {
+        ExpectNoError("(set-car! (cdr x) (cons counter (car (cdr x))))");
+        ExpectNoError("(set! counter (+ counter 1))");
+    }
+    ExpectEq("(car (car (cdr x)))", "49");
+    ExpectEq("(car (cdr (cdr x)))", "3");
+    ExpectEq("counter", "50");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ClosuresSurvivePromotion") {
+    ExpectNoError("(define (make-acc x) (lambda (y) (set! x (cons y x)) x))");
+    ExpectNoError("(define acc (make-acc '()))");
+    for (int i = 0; i < 20; ++i) {
+        ExpectNoError("(acc " + std::to_string(i) + ")");
+    }
+    ExpectEq("(acc 20)", "(20 19 18 17 16 15 14 13 12 11 10 9 8 7 6 5 4 3 2 1 0)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "RecycledFramesKeepValues") {
+    GetHeap().SetIncremental(4);
+    GetHeap().SetPolicy({.min_threshold = 1 << 10});
+    ExpectNoError("(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+    ExpectNoError("(define (total lst) (if (null? lst) 0 (+ (car lst) (total (cdr lst)))))");
+    for (int i = 0; i < 50; ++i) {
+        ExpectEq("(total (build 40 '()))", "820");
+    }
+    ExpectNoError("(gc)");
+    ExpectEq("(total (build 40 '()))", "820");
+}
+
+TEST_CASE_METHOD(SchemeTest, "WithoutNursery") {
+    GetHeap().SetGenerational(false);
+    ExpectNoError("(define x '(1 . 2))");
+    ExpectNoError("(set-cdr! x (list 3 4))");
+    ExpectNoError("(define (f n) (if (= n 0) x (f (- n 1))))");
+    ExpectEq("(f 10)", "(1 3 4)");
+    GetHeap().SetGenerational(true);
+    ExpectEq("(f 10)", "(1 3 4)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "IncrementalCollection") {
+    GetHeap().SetGenerational(false);
+    GetHeap().SetIncremental(4);
+    GetHeap().SetPolicy({.min_threshold = 1 << 10});
+    auto majors = GetHeap().GetStats().major_collections;
+
+    ExpectNoError("(define (range n) (if (= n 0) '() (cons n (range (- n 1)))))");
+    ExpectNoError("(define keep (range 50))");
+    for (int i = 0; i < 100; ++i) {
+        ExpectNoError("(set-car! keep (range 10))");
+        ExpectNoError("(set-cdr! (cdr keep) (cdr (cdr keep)))");
+    }
+    ExpectEq("(car (car keep))", "10");
+    ExpectEq("(car (cdr keep))", "49");
+    REQUIRE(GetHeap().GetStats().major_collections > majors);
+    REQUIRE(GetHeap().GetStats().max_pause.count() > 0);
+}
+
+TEST_CASE_METHOD(SchemeTest, "LongListMarking") {
+    std::string definition = "(define lst '(";
+    for (int i = 0; i < 300'000; ++i) {
+        definition += std::to_string(i) + ' ';
+    }
+    ExpectNoError(definition + "))");
+
+    GetHeap().SetGenerational(false);
+    ExpectNoError("(gc)");
+    ExpectEq("(car (cdr lst))", "1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "CollectionOnDemand") {
+    auto majors = GetHeap().GetStats().major_collections;
+    ExpectEq("(+ 1 2)", "3");
+    REQUIRE(GetHeap().GetStats().major_collections == majors);
+
+    ExpectNoError("(define x (list 1 2 3))");
+    ExpectEq("(gc)", "()");
+    REQUIRE(GetHeap().GetStats().major_collections > majors);
+    ExpectEq("x", "(1 2 3)");
+    ExpectRuntimeError("(gc 1)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "CollectionUnderPressure") {
+    GetHeap().SetGenerational(false);
+    auto majors = GetHeap().GetStats().major_collections;
+    ExpectNoError("(define (range n) (if (= n 0) '() (cons n (range (- n 1)))))");
+    WITH_ALLOCATION_DIFFERENCE_CHECK(10'000, {
+        for (int i = 0; i < 500; ++i) {
+            ExpectNoError("(range 100)");
+            // Garbage only piles up until the threshold of the next major collection.
+            REQUIRE(GetHeap().GetLiveBytes() <= kMinMajorThreshold + kPageSize);
+        }
+    });
+    REQUIRE(GetHeap().GetStats().major_collections > majors);
+}
+
+TEST_CASE_METHOD(SchemeTest, "ParallelCollection") {
+    GetHeap().SetParallelism(4);
+    ExpectNoError("(define (tree d) (if (= d 0) '() (cons (tree (- d 1)) (tree (- d 1)))))");
+    ExpectNoError("(define (size t) (if (null? t) 0 (+ 1 (size (car t)) (size (cdr t)))))");
+    ExpectNoError("(define t (tree 12))");
+    ExpectNoError("(define garbage (tree 12))");
+    ExpectNoError("(set! garbage '())");
+    ExpectNoError("(gc)");
+    ExpectEq("(size t)", "4095");
+    ExpectNoError("(set-car! t (tree 3))");
+    ExpectNoError("(gc)");
+    ExpectEq("(size t)", "2055");
+}
+
+TEST_CASE("IndependentHeaps") {
+    auto first = std::make_unique<Interpreter>();
+    Interpreter second;
+    first->Run("(define x (list 1 2))");
+    second.Run("(define x (list 3 4))");
+    first->Run("(gc)");
+    REQUIRE(second.Run("x") == "(3 4)");
+    first.reset();
+    second.Run("(gc)");
+    REQUIRE(second.Run("x") == "(3 4)");
+}
+
+TEST_CASE("InterpreterPerThread") {
+    std::vector<std::string> results(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&results, i] {
+            Interpreter interpreter;
+            interpreter.Run("(define (range n) (if (= n 0) '() (cons n (range (- n 1)))))");
+            for (int j = 0; j < 100; ++j) {
+                interpreter.Run("(range 50)");
+            }
+            interpreter.Run("(gc)");
+            results[i] = interpreter.Run("(range " + std::to_string(i + 1) + ")");
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(results[0] == "(1)");
+    REQUIRE(results[3] == "(4 3 2 1)");
+}
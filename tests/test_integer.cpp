@@ -112,3 +112,16 @@ TEST_CASE_METHOD(SchemeTest, "IntegerAbsEdgeCases") {
     ExpectRuntimeError("(abs #t)");
     ExpectRuntimeError("(abs 1 2)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "IntegersBeyondFixnumRange") {
+    ExpectEq("4611686018427387903", "4611686018427387903");
+    ExpectEq("4611686018427387904", "4611686018427387904");
+    ExpectEq("-4611686018427387905", "-4611686018427387905");
+    ExpectEq("(+ 4611686018427387903 1)", "4611686018427387904");
+    ExpectEq("(- 4611686018427387904 1)", "4611686018427387903");
+    ExpectEq("(- -4611686018427387904 1)", "-4611686018427387905");
+    ExpectEq("(* 4611686018427387904 -2)", "-9223372036854775808");
+    ExpectEq("(number? 9223372036854775807)", "#t");
+    ExpectEq("(= 4611686018427387904 (+ 4611686018427387903 1))", "#t");
+    ExpectEq("(abs -4611686018427387905)", "4611686018427387905");
+}
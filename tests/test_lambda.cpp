@@ -1,4 +1,5 @@
 #include <string>
+#include <thread>
 #include <iostream>
 
 #include "scheme_test.h"
@@ -157,3 +158,99 @@ TEST_CASE_METHOD(SchemeTest, "Redefinition and scoping") {
     ExpectEq("((foobar) 1 2)", "3");
     ExpectEq("(+ 1 2 -3)", "0");
 }
+
+TEST_CASE_METHOD(SchemeTest, "LocalsOfEnclosingLambdas") {
+    ExpectNoError(R"EOF(
+        (define (make-counter start)
+            (define step 2)
+            (lambda (times)
+                (define (advance n) (if (= n 0) start (begin-loop n)))
+                (define (begin-loop n) (set! start (+ start step)) (advance (- n 1)))
+                (advance times)))
+    )EOF");
+    ExpectNoError("(define counter (make-counter 10))");
+    ExpectEq("(counter 1)", "12");
+    ExpectEq("(counter 3)", "18");
+    ExpectNameError("start");
+    ExpectNameError("step");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ParametersShadowSpecialForms") {
+    ExpectNoError("(define (f quote) (quote 5))");
+    ExpectEq("(f (lambda (x) (* x 2)))", "10");
+    ExpectNoError("(define (g define x) (define x))");
+    ExpectEq("(g (lambda (x) (+ x 1)) 41)", "42");
+    ExpectEq("((lambda (set! y) (set! y 3)) - 7)", "4");
+}
+
+TEST_CASE_METHOD(SchemeTest, "LocalsFallBackUntilDefined") {
+    ExpectNoError("(define y 1)");
+    ExpectNoError("(define (f c) (if c (define y 2)) y)");
+    ExpectEq("(f #f)", "1");
+    ExpectEq("(f #t)", "2");
+    ExpectEq("y", "1");
+
+    ExpectNoError("(define (g) (set! y 5) (define y 3) y)");
+    ExpectEq("(g)", "3");
+    ExpectEq("y", "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "RepeatedParameters") {
+    ExpectEq("((lambda (x x) x) 1 2)", "2");
+    ExpectRuntimeError("((lambda (x x) x) 1)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "FramesCapturedAtRunTime") {
+    ExpectNoError("(define make lambda)");
+    ExpectNoError("(define (f x) (make () x))");
+    ExpectNoError("(define g (f 5))");
+    ExpectNoError("(define h (f 6))");
+    ExpectEq("(g)", "5");
+    ExpectEq("(h)", "6");
+}
+
+TEST_CASE_METHOD(SchemeTest, "FramesAfterErrors") {
+    ExpectNoError("(define (f x) (if (= x 0) (car '()) (+ x (f (- x 1)))))");
+    ExpectNoError("(define (g x) (if (= x 0) 0 (+ x (g (- x 1)))))");
+    ExpectRuntimeError("(f 10)");
+    ExpectEq("(g 10)", "55");
+    ExpectRuntimeError("(f 3)");
+    ExpectEq("(g 3)", "6");
+}
+
+TEST_CASE_METHOD(SchemeTest, "TailCallsRunInConstantStack") {
+    ExpectNoError("(define (slow-add x y) (if (= x 0) y (slow-add (- x 1) (+ y 1))))");
+    ExpectEq("(slow-add 300000 1)", "300001");
+
+    ExpectNoError("(define (even? n) (or (= n 0) (and (> n 0) (odd? (- n 1)))))");
+    ExpectNoError("(define (odd? n) (and (> n 0) (even? (- n 1))))");
+    ExpectEq("(even? 300000)", "#t");
+    ExpectEq("(odd? 300000)", "#f");
+
+    ExpectNoError("(define (count-down n) (define m (- n 1)) (if (< m 0) 'done (count-down m)))");
+    ExpectEq("(count-down 300000)", "done");
+}
+
+TEST_CASE_METHOD(SchemeTest, "RecursionBeyondNativeStack") {
+    ExpectNoError("(define (iota n acc) (if (= n 0) acc (iota (- n 1) (cons n acc))))");
+    ExpectNoError("(define (length l) (if (null? l) 0 (+ 1 (length (cdr l)))))");
+    ExpectNoError("(define l (iota 120000 '()))");
+    for (bool bytecode : {true, false}) {
+        GetContext().SetBytecode(bytecode);
+        ExpectEq("(length l)", "120000");
+        GetContext().SetMaxDepth(100000);
+        ExpectRuntimeError("(length l)");
+        ExpectEq("(length (iota 1000 '()))", "1000");
+        GetContext().SetMaxDepth(kMaxDepth);
+    }
+}
+
+TEST_CASE_METHOD(SchemeTest, "RecursionAfterMovingThreads") {
+    std::thread([&] {
+        ExpectNoError("(define (iota n acc) (if (= n 0) acc (iota (- n 1) (cons n acc))))");
+        ExpectNoError("(define (length l) (if (null? l) 0 (+ 1 (length (cdr l)))))");
+        ExpectEq("(length (iota 1000 '()))", "1000");
+    }).join();
+    ExpectEq("(length (iota 120000 '()))", "120000");
+    std::thread([&] { ExpectEq("(length (iota 120000 '()))", "120000"); }).join();
+}
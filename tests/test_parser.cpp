@@ -5,11 +5,13 @@
 #include <error.h>
 #include <parser.h>
 
+static Heap heap;
+
 auto ReadFull(const std::string& str) {
     std::stringstream ss{str};
     Tokenizer tokenizer{&ss};
 
-    auto obj = Read(&tokenizer);
+    auto obj = Read(&tokenizer, &heap);
     REQUIRE(tokenizer.IsEnd());
     return obj;
 }
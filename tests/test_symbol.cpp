@@ -1,3 +1,5 @@
+#include <string>
+
 #include "scheme_test.h"
 
 TEST_CASE_METHOD(SchemeTest, "SymbolsAreNotSelfEvaluating") {
@@ -57,3 +59,20 @@ TEST_CASE_METHOD(SchemeTest, "CopySemantics") {
 TEST_CASE_METHOD(SchemeTest, "EvaluationOrder") {
     ExpectNameError("(define x x)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "SymbolsAreInterned") {
+    auto first = GetHeap().Intern("some-name");
+    REQUIRE(GetHeap().Intern("some-name") == first);
+    REQUIRE(GetHeap().Intern("other-name") != first);
+
+    ExpectNoError("(define some-name '(some-name other-name))");
+    ExpectNoError("(gc)");
+    REQUIRE(GetHeap().Intern("some-name") == first);
+    ExpectEq("some-name", "(some-name other-name)");
+
+    for (int i = 0; i < 10; ++i) {
+        ExpectEq("'unused-" + std::to_string(i), "unused-" + std::to_string(i));
+    }
+    ExpectNoError("(gc)");
+    ExpectEq("'unused-0", "unused-0");
+}
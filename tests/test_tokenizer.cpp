@@ -3,7 +3,12 @@
 #include <error.h>
 #include <tokenizer.h>
 
+#include <filesystem>
+#include <fstream>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 TEST_CASE("Tokenizer works on simple case") {
     std::stringstream ss{"4+)'."};
@@ -153,3 +158,130 @@ TEST_CASE("Empty string handled correctly") {
 
     REQUIRE(tokenizer.IsEnd());
 }
+
+TEST_CASE("Tokenizer over a buffer") {
+    std::string input = "(foo 12 'bar-baz?)";
+    BufferTokenizer tokenizer{input};
+
+    REQUIRE(tokenizer.GetToken() == Token{BracketToken::OPEN});
+    tokenizer.Next();
+    auto foo = std::get<SymbolToken>(tokenizer.GetToken()).name;
+    REQUIRE(foo == "foo");
+    REQUIRE(foo.data() == input.data() + 1);
+
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{ConstantToken{12}});
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{QuoteToken{}});
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"bar-baz?"}});
+    REQUIRE(std::get<SymbolToken>(tokenizer.GetToken()).name.data() == input.data() + 9);
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{BracketToken::CLOSE});
+    tokenizer.Next();
+    REQUIRE(tokenizer.IsEnd());
+    REQUIRE(foo == "foo");
+
+    BufferTokenizer bad{"  \t"};
+    REQUIRE_THROWS_AS(bad.IsEnd(), SyntaxError);
+}
+
+TEST_CASE("Streams are read in chunks") {
+    // Long enough for tokens to straddle the chunks read from the stream.
+    std::string input;
+    for (int i = 0; input.size() < 300'000; ++i) {
+        input += "(" + std::string(i % 500 + 1, 'x') + " -" + std::to_string(i * 7919) + ")\n";
+    }
+    std::stringstream ss{input};
+    Tokenizer streamed{&ss};
+    BufferTokenizer buffered{input};
+    size_t count = 0;
+    while (!buffered.IsEnd()) {
+        REQUIRE(!streamed.IsEnd());
+        REQUIRE(streamed.GetToken() == buffered.GetToken());
+        streamed.Next();
+        buffered.Next();
+        ++count;
+    }
+    REQUIRE(streamed.IsEnd());
+    REQUIRE(count > 4'000);
+}
+
+TEST_CASE("Mapped files") {
+    auto path = (std::filesystem::temp_directory_path() / "scheme_tokenizer_test.scm").string();
+    std::ofstream{path} << "(+ 1 2)";
+    {
+        MappedFile file{path};
+        REQUIRE(file.GetContents() == "(+ 1 2)");
+        BufferTokenizer tokenizer{file.GetContents()};
+        tokenizer.Next();
+        REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"+"}});
+    }
+    std::ofstream{path};
+    {
+        MappedFile file{path};
+        REQUIRE(BufferTokenizer{file.GetContents()}.IsEnd());
+    }
+    std::filesystem::remove(path);
+    REQUIRE_THROWS_AS(MappedFile{path}, RuntimeError);
+}
+
+namespace {
+std::vector<std::string> Describe(std::string_view input) {
+    std::vector<std::string> tokens;
+    BufferTokenizer tokenizer{input};
+    try {
+        for (; !tokenizer.IsEnd(); tokenizer.Next()) {
+            auto token = tokenizer.GetToken();
+            if (auto symbol = std::get_if<SymbolToken>(&token)) {
+                tokens.emplace_back(symbol->name);
+            } else if (auto constant = std::get_if<ConstantToken>(&token)) {
+                tokens.push_back(std::to_string(constant->value));
+            } else {
+                tokens.push_back("index " + std::to_string(token.index()));
+            }
+        }
+    } catch (const SyntaxError&) {
+        tokens.push_back("error");
+    }
+    return tokens;
+}
+}  // namespace
+
+TEST_CASE("Scan widths agree") {
+    auto widest = GetScanWidth();
+    std::vector<std::string> inputs;
+    for (int sym = 0; sym < 256; ++sym) {
+        inputs.push_back("a" + std::string(40, static_cast<char>(sym)) + " 7");
+        inputs.push_back(std::string(37, static_cast<char>(sym)) + "x");
+    }
+    std::string digits = "-";
+    for (int i = 1; i <= 19; ++i) {
+        digits += std::to_string(i % 10);
+        inputs.push_back(digits + " " + digits.substr(1) + "(" + std::string(i * 3, ' ') + ")");
+    }
+    std::string program;
+    for (int i = 0; i < 2000; ++i) {
+        program += "(define (f-" + std::to_string(i) + " x) (* x " + std::to_string(i * 104729) +
+                   "))" + std::string(i % 70, i % 3 ? ' ' : '\n');
+    }
+    inputs.push_back(program);
+
+    std::vector<std::vector<std::string>> expected;
+    SetScanWidth(ScanWidth::kScalar);
+    for (const auto& input : inputs) {
+        expected.push_back(Describe(input));
+    }
+    REQUIRE(expected[2 * 'b'] == std::vector<std::string>{"a" + std::string(40, 'b'), "7"});
+    REQUIRE(expected[2 * '\t'] == std::vector<std::string>{"a", "error"});
+    REQUIRE(expected[2 * 256 + 18] ==
+            std::vector<std::string>{"-1234567890123456789", "1234567890123456789", "index 1",
+                                     "index 1"});
+    for (auto width : {ScanWidth::kSse2, ScanWidth::kAvx2}) {
+        SetScanWidth(width);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            REQUIRE(Describe(inputs[i]) == expected[i]);
+        }
+    }
+    SetScanWidth(widest);
+}
@@ -1,29 +1,222 @@
 #include <tokenizer.h>
 #include <error.h>
 
-const std::string kGoodChars = "<=>*/#!+-()";
-const std::string kSymBody = "<=>*/#?!-";
-const std::string kSymStart = "<=>*/#+-";
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 
-bool IsGoodChar(int sym) {
-    if (sym == EOF) {
-        return false;
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const std::string_view kSymBody = "<=>*/#?!-";
+const std::string_view kSymStart = "<=>*/#+-";
+const size_t kChunkSize = 1 << 16;
+const size_t kScalarPrefix = 8;
+
+enum CharClass : uint8_t {
+    kEmptyChar = 1,
+    kDigitChar = 2,
+    kSymStartChar = 4,
+    kSymBodyChar = 8,
+};
+
+constexpr std::array<uint8_t, 256> MakeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    classes[' '] = classes['\n'] = kEmptyChar;
+    for (int c = '0'; c <= '9'; ++c) {
+        classes[c] = kDigitChar | kSymBodyChar;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        classes[c] = classes[c - 'a' + 'A'] = kSymStartChar | kSymBodyChar;
     }
-    return isalnum(sym) || kGoodChars.find(sym) != std::string::npos;
+    for (auto c : kSymStart) {
+        classes[static_cast<uint8_t>(c)] |= kSymStartChar;
+    }
+    for (auto c : kSymBody) {
+        classes[static_cast<uint8_t>(c)] |= kSymBodyChar;
+    }
+    return classes;
+}
+
+constexpr auto kCharClasses = MakeCharClasses();
+
+bool HasClass(char sym, uint8_t mask) {
+    return kCharClasses[static_cast<uint8_t>(sym)] & mask;
 }
 
-bool IsSymBody(int sym) {
-    if (sym == EOF) {
-        return false;
+// The number of chars at the start of `data` which are of class `kClass`.
+template <uint8_t kClass>
+size_t CountScalar(const char* data, size_t size) {
+    size_t count = 0;
+    while (count < size && HasClass(data[count], kClass)) {
+        ++count;
     }
-    return isalnum(sym) || kSymBody.find(sym) != std::string::npos;
+    return count;
 }
 
-bool IsSymStart(int sym) {
-    if (sym == EOF) {
-        return false;
+#if defined(__x86_64__)
+
+// The vector versions test the same classes as kCharClasses, by ranges of chars: the test of
+// the tokenizer checks them against each other on every byte.
+
+__m128i InRange(__m128i chars, char first, char last) {
+    auto offsets = _mm_sub_epi8(chars, _mm_set1_epi8(first));
+    auto beyond = _mm_subs_epu8(offsets, _mm_set1_epi8(last - first));
+    return _mm_cmpeq_epi8(beyond, _mm_setzero_si128());
+}
+
+__m128i Equals(__m128i chars, char sym) {
+    return _mm_cmpeq_epi8(chars, _mm_set1_epi8(sym));
+}
+
+template <uint8_t kClass>
+__m128i Classify(__m128i chars) {
+    if constexpr (kClass == kEmptyChar) {
+        return _mm_or_si128(Equals(chars, ' '), Equals(chars, '\n'));
+    } else if constexpr (kClass == kDigitChar) {
+        return InRange(chars, '0', '9');
+    } else {
+        static_assert(kClass == kSymBodyChar);
+        auto ranges =
+            _mm_or_si128(_mm_or_si128(InRange(chars, '0', '9'), InRange(chars, '<', '?')),
+                         _mm_or_si128(InRange(chars, 'A', 'Z'), InRange(chars, 'a', 'z')));
+        auto signs =
+            _mm_or_si128(_mm_or_si128(Equals(chars, '!'), Equals(chars, '#')),
+                         _mm_or_si128(Equals(chars, '*'), Equals(chars, '-')));
+        return _mm_or_si128(_mm_or_si128(ranges, signs), Equals(chars, '/'));
+    }
+}
+
+template <uint8_t kClass>
+size_t CountSse2(const char* data, size_t size) {
+    size_t count = 0;
+    for (; count + 16 <= size; count += 16) {
+        auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + count));
+        uint32_t others = ~_mm_movemask_epi8(Classify<kClass>(chars)) & 0xFFFF;
+        if (others) {
+            return count + __builtin_ctz(others);
+        }
+    }
+    return count + CountScalar<kClass>(data + count, size - count);
+}
+
+[[gnu::target("avx2")]] __m256i InRange(__m256i chars, char first, char last) {
+    auto offsets = _mm256_sub_epi8(chars, _mm256_set1_epi8(first));
+    auto beyond = _mm256_subs_epu8(offsets, _mm256_set1_epi8(last - first));
+    return _mm256_cmpeq_epi8(beyond, _mm256_setzero_si256());
+}
+
+[[gnu::target("avx2")]] __m256i Equals(__m256i chars, char sym) {
+    return _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(sym));
+}
+
+template <uint8_t kClass>
+[[gnu::target("avx2")]] __m256i Classify(__m256i chars) {
+    if constexpr (kClass == kEmptyChar) {
+        return _mm256_or_si256(Equals(chars, ' '), Equals(chars, '\n'));
+    } else if constexpr (kClass == kDigitChar) {
+        return InRange(chars, '0', '9');
+    } else {
+        static_assert(kClass == kSymBodyChar);
+        auto ranges =
+            _mm256_or_si256(_mm256_or_si256(InRange(chars, '0', '9'), InRange(chars, '<', '?')),
+                            _mm256_or_si256(InRange(chars, 'A', 'Z'), InRange(chars, 'a', 'z')));
+        auto signs =
+            _mm256_or_si256(_mm256_or_si256(Equals(chars, '!'), Equals(chars, '#')),
+                            _mm256_or_si256(Equals(chars, '*'), Equals(chars, '-')));
+        return _mm256_or_si256(_mm256_or_si256(ranges, signs), Equals(chars, '/'));
+    }
+}
+
+template <uint8_t kClass>
+[[gnu::target("avx2")]] size_t CountAvx2(const char* data, size_t size) {
+    size_t count = 0;
+    for (; count + 32 <= size; count += 32) {
+        auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + count));
+        uint32_t others = ~_mm256_movemask_epi8(Classify<kClass>(chars));
+        if (others) {
+            return count + __builtin_ctz(others);
+        }
+    }
+    return count + CountSse2<kClass>(data + count, size - count);
+}
+
+ScanWidth FindScanWidth() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? ScanWidth::kAvx2 : ScanWidth::kSse2;
+}
+
+#else
+
+ScanWidth FindScanWidth() {
+    return ScanWidth::kScalar;
+}
+
+#endif
+
+// Both are kScalar until they are initialized. Tokenizers on any thread may read the width
+// while it is set, and only need to see either value.
+const ScanWidth kMaxScanWidth = FindScanWidth();
+std::atomic<ScanWidth> scan_width = kMaxScanWidth;
+
+template <uint8_t kClass>
+size_t Count(const char* data, size_t size) {
+#if defined(__x86_64__)
+    auto width = scan_width.load(std::memory_order_relaxed);
+    if (width == ScanWidth::kAvx2) {
+        return CountAvx2<kClass>(data, size);
+    }
+    if (width == ScanWidth::kSse2) {
+        return CountSse2<kClass>(data, size);
     }
-    return isalpha(sym) || kSymStart.find(sym) != std::string::npos;
+#endif
+    return CountScalar<kClass>(data, size);
+}
+
+// Converts eight digits at once, pairing neighbours into 16-bit lanes, then those into 32-bit
+// ones, then the two halves.
+uint64_t ParseEightDigits(const char* digits) {
+    uint64_t chunk;
+    std::memcpy(&chunk, digits, sizeof(chunk));
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FF;
+    chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFF;
+    return (chunk * 10000 + (chunk >> 32)) & 0xFFFFFFFF;
+}
+
+// Wraps around like the digit-by-digit sum would.
+uint64_t ParseDigits(const char* digits, size_t count) {
+    uint64_t value = 0;
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= count; i += 8) {
+        value = value * 100'000'000 + ParseEightDigits(digits + i);
+    }
+#endif
+    for (; i < count; ++i) {
+        value = value * 10 + (digits[i] - '0');
+    }
+    return value;
+}
+
+}  // namespace
+
+void SetScanWidth(ScanWidth width) {
+    scan_width.store(std::min(width, kMaxScanWidth), std::memory_order_relaxed);
+}
+
+ScanWidth GetScanWidth() {
+    return scan_width.load(std::memory_order_relaxed);
 }
 
 bool SymbolToken::operator==(const SymbolToken& other) const {
@@ -42,37 +235,78 @@ bool ConstantToken::operator==(const ConstantToken& other) const {
     return value == other.value;
 }
 
-void Tokenizer::SkipEmptyChars() {
-    while (!in_->eof() && (in_->peek() == ' ' || in_->peek() == '\n')) {
-        in_->get();
+BufferTokenizer::BufferTokenizer(std::string_view input)
+    : data_(input.data()), size_(input.size()) {
+}
+
+bool BufferTokenizer::Refill(size_t) {
+    return false;
+}
+
+void BufferTokenizer::SetBuffer(std::string_view buffer) {
+    data_ = buffer.data();
+    size_ = buffer.size();
+}
+
+bool BufferTokenizer::Fill(size_t count) {
+    while (size_ - pos_ < count) {
+        auto consumed = start_;
+        if (!Refill(consumed)) {
+            return false;
+        }
+        pos_ -= consumed;
+        start_ = 0;
+    }
+    return true;
+}
+
+// Most runs are over within a few chars, before a vector would even have been loaded, so
+// vectors only take over past kScalarPrefix.
+template <uint8_t kClass>
+[[gnu::always_inline]] inline void BufferTokenizer::SkipRun() {
+    for (auto end = std::min(size_, pos_ + kScalarPrefix); pos_ < end; ++pos_) {
+        if (!HasClass(data_[pos_], kClass)) {
+            return;
+        }
     }
+    SkipLongRun<kClass>();
 }
 
-Tokenizer::Tokenizer(std::istream* in) : in_(in), is_end_(false), without_token_(true) {
+template <uint8_t kClass>
+void BufferTokenizer::SkipLongRun() {
+    do {
+        pos_ += Count<kClass>(data_ + pos_, size_ - pos_);
+        if constexpr (kClass == kEmptyChar) {
+            start_ = pos_;
+        }
+    } while (pos_ == size_ && HasChars(1));
 }
 
-bool Tokenizer::IsEnd() {
+bool BufferTokenizer::IsEnd() {
     if (without_token_) {
         NextOnce();
     }
     return is_end_;
 }
 
-void Tokenizer::NextOnce() {
-    SkipEmptyChars();
+void BufferTokenizer::NextOnce() {
+    SkipRun<kEmptyChar>();
+    start_ = pos_;
     without_token_ = false;
-    if (in_->eof()) {
+    if (!HasChars(1)) {
         is_end_ = true;
         return;
     }
-    auto x = in_->get();
-    if (isdigit(x) || ((x == '+' || x == '-') && isdigit(in_->peek()))) {
+    auto x = data_[pos_++];
+    if (HasClass(x, kDigitChar) ||
+        ((x == '+' || x == '-') && HasChars(1) && HasClass(data_[pos_], kDigitChar))) {
         bool is_neg = (x == '-');
-        int64_t val = (isdigit(x) ? x - '0' : 0);
-        while (isdigit(in_->peek())) {
-            val = 10 * val + (in_->get() - '0') * (is_neg ? -1 : 1);
-        }
-        cur_token_ = Token{ConstantToken{val}};
+        // Relative to start_, which stays put if the buffer is refilled.
+        auto first_digit = pos_ - start_ - (HasClass(x, kDigitChar) ? 1 : 0);
+        SkipRun<kDigitChar>();
+        auto digits = data_ + start_ + first_digit;
+        auto val = ParseDigits(digits, data_ + pos_ - digits);
+        cur_token_ = Token{ConstantToken{static_cast<int64_t>(is_neg ? -val : val)}};
     } else if (x == '(' || x == ')') {
         cur_token_ = Token{x == '(' ? BracketToken::OPEN : BracketToken::CLOSE};
     } else if (x == '\'') {
@@ -80,26 +314,78 @@ void Tokenizer::NextOnce() {
     } else if (x == '.') {
         cur_token_ = Token{DotToken{}};
     } else {
-        if (!IsSymStart(x)) {
+        if (!HasClass(x, kSymStartChar)) {
             throw SyntaxError("Bad symbolic start");
         }
-        std::string cur_str(1, x);
-        while (IsSymBody(in_->peek())) {
-            cur_str.push_back(in_->get());
-        }
-        cur_token_ = Token{SymbolToken{cur_str}};
+        SkipRun<kSymBodyChar>();
+        cur_token_ = Token{SymbolToken{{data_ + start_, pos_ - start_}}};
     }
 }
 
-void Tokenizer::Next() {
+void BufferTokenizer::Next() {
     if (without_token_) {
         NextOnce();
     }
     NextOnce();
 }
-Token Tokenizer::GetToken() {
+
+Token BufferTokenizer::GetToken() {
     if (without_token_) {
         NextOnce();
     }
     return cur_token_;
 }
+
+Tokenizer::Tokenizer(std::istream* in) : BufferTokenizer({}), in_(in) {
+}
+
+// readsome only takes what the stream has buffered, and peek waits for more, so that the input
+// is never read past what is available yet.
+bool Tokenizer::Refill(size_t consumed) {
+    auto size = buffer_.size();
+    buffer_.resize(size + kChunkSize);
+    auto count = in_->readsome(buffer_.data() + size, kChunkSize);
+    if (!count && in_->peek() != EOF) {
+        count = in_->readsome(buffer_.data() + size, kChunkSize);
+        if (!count) {
+            buffer_[size] = in_->get();
+            count = 1;
+        }
+    }
+    buffer_.resize(size + count);
+    if (count) {
+        buffer_.erase(0, consumed);
+    }
+    SetBuffer(buffer_);
+    return count > 0;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw RuntimeError("Unable to open " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info)) {
+        close(fd);
+        throw RuntimeError("Unable to open " + path);
+    }
+    // Empty files cannot be mapped.
+    if (info.st_size > 0) {
+        pages_ = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (pages_ == MAP_FAILED) {
+        pages_ = nullptr;
+        throw RuntimeError("Unable to map " + path);
+    }
+    if (pages_) {
+        size_ = info.st_size;
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (pages_) {
+        munmap(pages_, size_);
+    }
+}
@@ -1,11 +1,15 @@
 #pragma once
 
-#include <variant>
-#include <optional>
+#include <cstddef>
+#include <cstdint>
 #include <istream>
+#include <string>
+#include <string_view>
+#include <variant>
 
+// Refers to the input of the tokenizer rather than owning a copy of the name.
 struct SymbolToken {
-    std::string name;
+    std::string_view name;
 
     bool operator==(const SymbolToken& other) const;
 };
@@ -28,9 +32,20 @@ struct ConstantToken {
 
 using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken, DotToken>;
 
-class Tokenizer {
+// How many chars at a time the tokenizer classifies, when it scans runs of whitespace, symbol
+// chars and digits. The default is the widest which the CPU supports, and so is the most that
+// can be set.
+enum class ScanWidth { kScalar, kSse2, kAvx2 };
+
+void SetScanWidth(ScanWidth width);
+ScanWidth GetScanWidth();
+
+// Tokenizes a contiguous buffer in place. Symbol tokens are slices of the buffer, so they stay
+// valid for as long as it does.
+class BufferTokenizer {
 public:
-    Tokenizer(std::istream* in);
+    explicit BufferTokenizer(std::string_view input);
+    virtual ~BufferTokenizer() = default;
 
     bool IsEnd();
 
@@ -38,12 +53,60 @@ public:
 
     Token GetToken();
 
+protected:
+    // Called once the buffer runs out in the middle of the input. Drops the first `consumed`
+    // chars of the buffer, which the current token does not need, appends more input through
+    // SetBuffer, and returns whether there was any.
+    virtual bool Refill(size_t consumed);
+    void SetBuffer(std::string_view buffer);
+
 private:
-    void SkipEmptyChars();
+    bool HasChars(size_t count) {
+        return size_ - pos_ >= count || Fill(count);
+    }
+    bool Fill(size_t count);
+    template <uint8_t kClass>
+    void SkipRun();
+    template <uint8_t kClass>
+    void SkipLongRun();
     void NextOnce();
 
-    std::istream* in_;
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    size_t start_ = 0;
     Token cur_token_;
-    bool is_end_;
-    bool without_token_;
-};
\ No newline at end of file
+    bool is_end_ = false;
+    bool without_token_ = true;
+};
+
+// Reads the stream in chunks, as far as it has input available, so that it can still be written
+// to between tokens. Symbol tokens stay valid until the tokenizer moves on.
+class Tokenizer : public BufferTokenizer {
+public:
+    Tokenizer(std::istream* in);
+
+protected:
+    bool Refill(size_t consumed) override;
+
+private:
+    std::istream* in_;
+    std::string buffer_;
+};
+
+// A file mapped into memory read-only, for BufferTokenizer.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view GetContents() const {
+        return {static_cast<const char*>(pages_), size_};
+    }
+
+private:
+    void* pages_ = nullptr;
+    size_t size_ = 0;
+};